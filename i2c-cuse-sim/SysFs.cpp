@@ -0,0 +1,336 @@
+/*
+ * SysFs.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "SysFs.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+struct SysFs::Node {
+	fuse_ino_t ino;
+	fuse_ino_t parent;
+	mode_t mode;
+	std::map<std::string, Node*> children;
+	Attribute attribute;
+	std::string target;
+	/** Incremented by notify. */
+	unsigned int event = 0;
+	std::vector<struct fuse_pollhandle*> pollers;
+};
+
+/**
+ * An open attribute. Remembers the event that has been seen by
+ * reading the file.
+ */
+struct SysFs::OpenFile {
+	Node *node;
+	unsigned int event;
+};
+
+SysFs::SysFs() {
+	nodes.emplace_back(new Node { FUSE_ROOT_ID, FUSE_ROOT_ID,
+		S_IFDIR | 0755 });
+}
+
+SysFs::~SysFs() {
+	stop();
+}
+
+SysFs::Node* SysFs::node(fuse_ino_t ino) {
+	return ino >= 1 && ino <= nodes.size() ? nodes[ino - 1].get() : nullptr;
+}
+
+/**
+ * Returns the node with the given path, creating it and its
+ * parent directories if necessary.
+ */
+SysFs::Node* SysFs::makePath(const std::string& path, mode_t mode) {
+	Node *current = nodes[0].get();
+	std::string::size_type start = 0;
+	while (start < path.size()) {
+		std::string::size_type end = path.find('/', start);
+		if (end == std::string::npos) {
+			end = path.size();
+		}
+		std::string name = path.substr(start, end - start);
+		start = end + 1;
+		if (name.empty()) {
+			continue;
+		}
+		auto child = current->children.find(name);
+		if (child != current->children.end()) {
+			current = child->second;
+			continue;
+		}
+		nodes.emplace_back(new Node { nodes.size() + 1, current->ino,
+			start >= path.size() ? mode : S_IFDIR | 0755 });
+		current->children[name] = nodes.back().get();
+		current = nodes.back().get();
+	}
+	return current;
+}
+
+void SysFs::addAttribute(const std::string& path, Attribute attribute) {
+	mode_t mode = S_IFREG | (attribute.show ? 0444 : 0)
+			| (attribute.store ? 0200 : 0);
+	Node *node = makePath(path, mode);
+	node->attribute = std::move(attribute);
+	attributes[path] = node;
+}
+
+void SysFs::addLink(const std::string& path, const std::string& target) {
+	makePath(path, S_IFLNK | 0777)->target = target;
+}
+
+void SysFs::notify(const std::string& path) {
+	auto attribute = attributes.find(path);
+	if (attribute == attributes.end()) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard(mutex);
+	Node *node = attribute->second;
+	node->event++;
+	for (struct fuse_pollhandle *ph : node->pollers) {
+		fuse_lowlevel_notify_poll(ph);
+		fuse_pollhandle_destroy(ph);
+	}
+	node->pollers.clear();
+}
+
+void SysFs::fillAttr(Node *node, struct stat *attr) {
+	std::memset(attr, 0, sizeof(*attr));
+	attr->st_ino = node->ino;
+	attr->st_mode = node->mode;
+	attr->st_nlink = S_ISDIR(node->mode) ? 2 : 1;
+	attr->st_uid = getuid();
+	attr->st_gid = getgid();
+	// Like sysfs, attributes report a page
+	attr->st_size = S_ISREG(node->mode) ? 4096 : S_ISLNK(node->mode)
+			? node->target.size() : 0;
+}
+
+SysFs& SysFs::of(fuse_req_t req) {
+	return *static_cast<SysFs*>(fuse_req_userdata(req));
+}
+
+void SysFs::lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+	SysFs& fs = of(req);
+	Node *dir = fs.node(parent);
+	if (!dir) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	auto child = dir->children.find(name);
+	if (child == dir->children.end()) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	struct fuse_entry_param entry;
+	std::memset(&entry, 0, sizeof(entry));
+	entry.ino = child->second->ino;
+	entry.attr_timeout = 1.0;
+	entry.entry_timeout = 1.0;
+	fs.fillAttr(child->second, &entry.attr);
+	fuse_reply_entry(req, &entry);
+}
+
+void SysFs::getattr(fuse_req_t req, fuse_ino_t ino,
+		struct fuse_file_info *fi) {
+	SysFs& fs = of(req);
+	Node *node = fs.node(ino);
+	if (!node) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	struct stat attr;
+	fs.fillAttr(node, &attr);
+	fuse_reply_attr(req, &attr, 1.0);
+}
+
+/**
+ * Attributes cannot be changed. Truncating (when opening with
+ * O_TRUNC) is accepted and ignored, as by sysfs.
+ */
+void SysFs::setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+		int to_set, struct fuse_file_info *fi) {
+	getattr(req, ino, fi);
+}
+
+void SysFs::readlink(fuse_req_t req, fuse_ino_t ino) {
+	Node *node = of(req).node(ino);
+	if (!node || !S_ISLNK(node->mode)) {
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
+	fuse_reply_readlink(req, node->target.c_str());
+}
+
+void SysFs::readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+		off_t off, struct fuse_file_info *fi) {
+	SysFs& fs = of(req);
+	Node *dir = fs.node(ino);
+	if (!dir || !S_ISDIR(dir->mode)) {
+		fuse_reply_err(req, ENOTDIR);
+		return;
+	}
+	std::vector<std::pair<std::string, Node*>> entries {
+		{ ".", dir }, { "..", fs.node(dir->parent) } };
+	entries.insert(entries.end(), dir->children.begin(),
+			dir->children.end());
+
+	std::vector<char> buf(size);
+	size_t used = 0;
+	for (size_t i = off; i < entries.size(); i++) {
+		struct stat attr;
+		fs.fillAttr(entries[i].second, &attr);
+		size_t entrySize = fuse_add_direntry(req, buf.data() + used,
+				size - used, entries[i].first.c_str(), &attr, i + 1);
+		if (entrySize > size - used) {
+			break;
+		}
+		used += entrySize;
+	}
+	fuse_reply_buf(req, buf.data(), used);
+}
+
+void SysFs::open(fuse_req_t req, fuse_ino_t ino,
+		struct fuse_file_info *fi) {
+	SysFs& fs = of(req);
+	Node *node = fs.node(ino);
+	if (!node || !S_ISREG(node->mode)) {
+		fuse_reply_err(req, EISDIR);
+		return;
+	}
+	int access = fi->flags & O_ACCMODE;
+	if ((access != O_WRONLY && !node->attribute.show)
+			|| (access != O_RDONLY && !node->attribute.store)) {
+		fuse_reply_err(req, EACCES);
+		return;
+	}
+	std::lock_guard<std::mutex> guard(fs.mutex);
+	fi->fh = reinterpret_cast<uint64_t>(new OpenFile { node, node->event });
+	// The content is generated on every read
+	fi->direct_io = 1;
+	fuse_reply_open(req, fi);
+}
+
+void SysFs::read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+		struct fuse_file_info *fi) {
+	SysFs& fs = of(req);
+	OpenFile *file = reinterpret_cast<OpenFile*>(fi->fh);
+
+	// Reading from the start re-arms the notification
+	if (off == 0) {
+		std::lock_guard<std::mutex> guard(fs.mutex);
+		file->event = file->node->event;
+	}
+	std::string content = file->node->attribute.show();
+	if ((size_t)off >= content.size()) {
+		fuse_reply_buf(req, nullptr, 0);
+		return;
+	}
+	fuse_reply_buf(req, content.data() + off,
+			std::min(size, content.size() - off));
+}
+
+void SysFs::write(fuse_req_t req, fuse_ino_t ino, const char *buf,
+		size_t size, off_t off, struct fuse_file_info *fi) {
+	OpenFile *file = reinterpret_cast<OpenFile*>(fi->fh);
+
+	int res = file->node->attribute.store(std::string(buf, size));
+	if (res < 0) {
+		fuse_reply_err(req, -res);
+		return;
+	}
+	fuse_reply_write(req, size);
+}
+
+void SysFs::release(fuse_req_t req, fuse_ino_t ino,
+		struct fuse_file_info *fi) {
+	delete reinterpret_cast<OpenFile*>(fi->fh);
+	fuse_reply_err(req, 0);
+}
+
+/**
+ * As with sysfs, a file is readable and writable at any time and
+ * signals POLLERR and POLLPRI if a notification has occurred since
+ * the file was last read.
+ */
+void SysFs::poll(fuse_req_t req, fuse_ino_t ino,
+		struct fuse_file_info *fi, struct fuse_pollhandle *ph) {
+	SysFs& fs = of(req);
+	OpenFile *file = reinterpret_cast<OpenFile*>(fi->fh);
+	unsigned int revents = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+
+	std::unique_lock<std::mutex> guard(fs.mutex);
+	if (file->event != file->node->event) {
+		revents |= POLLERR | POLLPRI;
+		if (ph) {
+			fuse_pollhandle_destroy(ph);
+		}
+	} else if (ph) {
+		file->node->pollers.push_back(ph);
+	}
+	guard.unlock();
+	fuse_reply_poll(req, revents);
+}
+
+bool SysFs::start(const std::string& mountPoint, bool debug) {
+	static struct fuse_lowlevel_ops ops;
+	ops.lookup = lookup;
+	ops.getattr = getattr;
+	ops.setattr = setattr;
+	ops.readlink = readlink;
+	ops.readdir = readdir;
+	ops.open = open;
+	ops.read = read;
+	ops.write = write;
+	ops.release = release;
+	ops.poll = poll;
+
+	std::vector<const char*> argv { "i2c-cuse-sim", "-o", "fsname=i2c-sim" };
+	if (debug) {
+		argv.push_back("-d");
+	}
+	struct fuse_args args = FUSE_ARGS_INIT((int)argv.size(),
+			const_cast<char**>(argv.data()));
+	session = fuse_session_new(&args, &ops, sizeof(ops), this);
+	if (!session) {
+		return false;
+	}
+	if (fuse_session_mount(session, mountPoint.c_str()) != 0) {
+		fuse_session_destroy(session);
+		session = nullptr;
+		return false;
+	}
+	loop = std::thread([this] { fuse_session_loop_mt(session, 0); });
+	return true;
+}
+
+void SysFs::stop() {
+	if (!session) {
+		return;
+	}
+	fuse_session_exit(session);
+	// Unmounting terminates the pending reads of the loop
+	fuse_session_unmount(session);
+	loop.join();
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		for (auto& node : nodes) {
+			for (struct fuse_pollhandle *ph : node->pollers) {
+				fuse_pollhandle_destroy(ph);
+			}
+			node->pollers.clear();
+		}
+	}
+	fuse_session_destroy(session);
+	session = nullptr;
+}
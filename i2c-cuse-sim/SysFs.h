@@ -0,0 +1,101 @@
+/*
+ * SysFs.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_CUSE_SIM_SYSFS_H_
+#define I2C_CUSE_SIM_SYSFS_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fuse_lowlevel.h>
+
+/**
+ * A FUSE file system that mimics the sysfs attributes of the kernel
+ * modules. Mounted somewhere, it provides the same paths relative
+ * to the mount point as sysfs relative to /sys. As with sysfs, each
+ * write to an attribute is handled on its own, and notifications
+ * are signaled to pollers with POLLPRI until the file has been read
+ * again (from the start).
+ */
+class SysFs {
+public:
+	struct Attribute {
+		/** Returns the content, nullptr if write only. */
+		std::function<std::string()> show;
+		/** Stores a write, returns 0 or -errno, nullptr if read only. */
+		std::function<int(const std::string&)> store;
+	};
+
+	SysFs();
+	SysFs(const SysFs&) = delete;
+	SysFs& operator=(const SysFs&) = delete;
+	~SysFs();
+
+	/**
+	 * Adds an attribute with the given path, creating the directories
+	 * as needed. Must be called before start().
+	 */
+	void addAttribute(const std::string& path, Attribute attribute);
+
+	/**
+	 * Adds a symbolic link with the given path. Must be called
+	 * before start().
+	 */
+	void addLink(const std::string& path, const std::string& target);
+
+	/** Notifies the pollers of the attribute (like sysfs_notify). */
+	void notify(const std::string& path);
+
+	/**
+	 * Mounts the file system and serves requests in a thread.
+	 * Returns false if mounting fails.
+	 */
+	bool start(const std::string& mountPoint, bool debug);
+
+	/** Unmounts the file system. */
+	void stop();
+
+private:
+	struct Node;
+	struct OpenFile;
+
+	std::vector<std::unique_ptr<Node>> nodes;
+	std::map<std::string, Node*> attributes;
+	std::mutex mutex;
+	struct fuse_session *session = nullptr;
+	std::thread loop;
+
+	Node* node(fuse_ino_t ino);
+	Node* makePath(const std::string& path, mode_t mode);
+	void fillAttr(Node *node, struct stat *attr);
+
+	static SysFs& of(fuse_req_t req);
+	static void lookup(fuse_req_t req, fuse_ino_t parent, const char *name);
+	static void getattr(fuse_req_t req, fuse_ino_t ino,
+			struct fuse_file_info *fi);
+	static void setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+			int to_set, struct fuse_file_info *fi);
+	static void readlink(fuse_req_t req, fuse_ino_t ino);
+	static void readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+			off_t off, struct fuse_file_info *fi);
+	static void open(fuse_req_t req, fuse_ino_t ino,
+			struct fuse_file_info *fi);
+	static void read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+			struct fuse_file_info *fi);
+	static void write(fuse_req_t req, fuse_ino_t ino, const char *buf,
+			size_t size, off_t off, struct fuse_file_info *fi);
+	static void release(fuse_req_t req, fuse_ino_t ino,
+			struct fuse_file_info *fi);
+	static void poll(fuse_req_t req, fuse_ino_t ino,
+			struct fuse_file_info *fi, struct fuse_pollhandle *ph);
+};
+
+#endif /* I2C_CUSE_SIM_SYSFS_H_ */
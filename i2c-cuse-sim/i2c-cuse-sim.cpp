@@ -0,0 +1,541 @@
+/*
+ * i2c-cuse-sim.cpp
+ *
+ * Provides a /dev/i2c-N with the simulated devices using CUSE, i.e.
+ * without the kernel modules. The device supports the operations
+ * of i2c-dev (read, write and the ioctls). Optionally, the sysfs
+ * attributes of the kernel modules are provided by a FUSE file
+ * system.
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <cuse_lowlevel.h>
+
+#include "Bus.h"
+#include "TestDevices.h"
+#include "SysFs.h"
+
+/** The maximum length of a message, as enforced by i2c-dev. */
+static constexpr size_t maxMsgLen = 8192;
+
+/** The state of an open device, corresponds to i2c-dev's client. */
+struct Client {
+	uint16_t addr = 0;
+	bool tenBit = false;
+	bool pec = false;
+};
+
+static sim::Bus& busOf(fuse_req_t req) {
+	return *static_cast<sim::Bus*>(fuse_req_userdata(req));
+}
+
+static Client& clientOf(struct fuse_file_info *fi) {
+	return *reinterpret_cast<Client*>(fi->fh);
+}
+
+static void cuseOpen(fuse_req_t req, struct fuse_file_info *fi) {
+	fi->fh = reinterpret_cast<uint64_t>(new Client());
+	fi->nonseekable = 1;
+	fuse_reply_open(req, fi);
+}
+
+static void cuseRelease(fuse_req_t req, struct fuse_file_info *fi) {
+	delete &clientOf(fi);
+	fuse_reply_err(req, 0);
+}
+
+static void cuseRead(fuse_req_t req, size_t size, off_t off,
+		struct fuse_file_info *fi) {
+	Client& client = clientOf(fi);
+	std::vector<uint8_t> buf(std::max<size_t>(
+			std::min(size, maxMsgLen), 1));
+	struct i2c_msg msg = { client.addr,
+		(uint16_t)((client.tenBit ? I2C_M_TEN : 0) | I2C_M_RD),
+		(uint16_t)std::min(size, maxMsgLen), buf.data() };
+
+	int ret = busOf(req).transfer(&msg, 1);
+	if (ret < 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	fuse_reply_buf(req, (const char*)buf.data(), msg.len);
+}
+
+static void cuseWrite(fuse_req_t req, const char *buf, size_t size,
+		off_t off, struct fuse_file_info *fi) {
+	Client& client = clientOf(fi);
+	std::vector<uint8_t> data(buf, buf + std::min(size, maxMsgLen));
+	data.reserve(1);
+	struct i2c_msg msg = { client.addr,
+		(uint16_t)(client.tenBit ? I2C_M_TEN : 0),
+		(uint16_t)data.size(), data.data() };
+
+	int ret = busOf(req).transfer(&msg, 1);
+	if (ret < 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	fuse_reply_write(req, msg.len);
+}
+
+/**
+ * Handles I2C_RDWR. With unrestricted ioctls, the data must be
+ * fetched in steps: the ioctl data, the messages and finally the
+ * messages' buffers. Each step is a retry of the request with
+ * the additional areas added.
+ */
+static void ioctlRdwr(fuse_req_t req, void *arg, const void *inBuf,
+		size_t inSize, size_t outSize) {
+	struct i2c_rdwr_ioctl_data rdwr;
+	std::vector<struct iovec> in { { arg, sizeof(rdwr) } };
+	std::vector<struct iovec> out;
+
+	if (inSize < sizeof(rdwr)) {
+		fuse_reply_ioctl_retry(req, in.data(), in.size(), nullptr, 0);
+		return;
+	}
+	std::memcpy(&rdwr, inBuf, sizeof(rdwr));
+	if (!rdwr.msgs || rdwr.nmsgs == 0
+			|| rdwr.nmsgs > I2C_RDWR_IOCTL_MAX_MSGS) {
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
+	size_t msgsSize = rdwr.nmsgs * sizeof(struct i2c_msg);
+	in.push_back({ rdwr.msgs, msgsSize });
+	if (inSize < sizeof(rdwr) + msgsSize) {
+		fuse_reply_ioctl_retry(req, in.data(), in.size(), nullptr, 0);
+		return;
+	}
+
+	// The messages as passed by the caller
+	std::vector<struct i2c_msg> msgs(rdwr.nmsgs);
+	std::memcpy(msgs.data(), (const char*)inBuf + sizeof(rdwr), msgsSize);
+	size_t required = sizeof(rdwr) + msgsSize;
+	size_t outRequired = 0;
+	for (struct i2c_msg& msg : msgs) {
+		if (msg.len > maxMsgLen) {
+			fuse_reply_err(req, EINVAL);
+			return;
+		}
+		if (msg.len == 0) {
+			continue;
+		}
+		// As i2c-dev, get the buffers of read messages as well
+		in.push_back({ msg.buf, msg.len });
+		required += msg.len;
+		if (msg.flags & I2C_M_RD) {
+			out.push_back({ msg.buf, msg.len });
+			outRequired += msg.len;
+		}
+	}
+	if (inSize < required || outSize < outRequired) {
+		fuse_reply_ioctl_retry(req, in.data(), in.size(),
+				out.data(), out.size());
+		return;
+	}
+
+	// Copy the buffers and check the messages as i2c-dev does
+	std::vector<uint8_t> data((const uint8_t*)inBuf + sizeof(rdwr)
+			+ msgsSize, (const uint8_t*)inBuf + required);
+	std::vector<uint16_t> lens(msgs.size());
+	size_t offset = 0;
+	for (size_t i = 0; i < msgs.size(); i++) {
+		struct i2c_msg& msg = msgs[i];
+		msg.buf = data.data() + offset;
+		offset += msg.len;
+		lens[i] = msg.len;
+		if (msg.flags & I2C_M_RECV_LEN) {
+			if (!(msg.flags & I2C_M_RD) || msg.len < 1 || msg.buf[0] < 1
+					|| msg.len < msg.buf[0] + I2C_SMBUS_BLOCK_MAX) {
+				fuse_reply_err(req, EINVAL);
+				return;
+			}
+			msg.len = msg.buf[0];
+		}
+	}
+
+	int ret = busOf(req).transfer(msgs.data(), msgs.size());
+	if (ret < 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+
+	// Return the buffers of the read messages
+	std::vector<uint8_t> reply;
+	reply.reserve(outRequired);
+	offset = 0;
+	for (size_t i = 0; i < msgs.size(); i++) {
+		if (msgs[i].flags & I2C_M_RD) {
+			reply.insert(reply.end(), data.begin() + offset,
+					data.begin() + offset + lens[i]);
+		}
+		offset += lens[i];
+	}
+	fuse_reply_ioctl(req, ret, reply.data(), reply.size());
+}
+
+/**
+ * Handles I2C_SMBUS, fetching and returning the data as i2c-dev does.
+ */
+static void ioctlSmbus(fuse_req_t req, Client& client, void *arg,
+		const void *inBuf, size_t inSize, size_t outSize) {
+	struct i2c_smbus_ioctl_data smbus;
+	std::vector<struct iovec> in { { arg, sizeof(smbus) } };
+	std::vector<struct iovec> out;
+
+	if (inSize < sizeof(smbus)) {
+		fuse_reply_ioctl_retry(req, in.data(), in.size(), nullptr, 0);
+		return;
+	}
+	std::memcpy(&smbus, inBuf, sizeof(smbus));
+	uint32_t size = smbus.size;
+	if ((size != I2C_SMBUS_BYTE && size != I2C_SMBUS_QUICK
+			&& size != I2C_SMBUS_BYTE_DATA && size != I2C_SMBUS_WORD_DATA
+			&& size != I2C_SMBUS_PROC_CALL && size != I2C_SMBUS_BLOCK_DATA
+			&& size != I2C_SMBUS_I2C_BLOCK_BROKEN
+			&& size != I2C_SMBUS_I2C_BLOCK_DATA
+			&& size != I2C_SMBUS_BLOCK_PROC_CALL)
+			|| (smbus.read_write != I2C_SMBUS_READ
+					&& smbus.read_write != I2C_SMBUS_WRITE)) {
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
+	bool noData = size == I2C_SMBUS_QUICK || (size == I2C_SMBUS_BYTE
+			&& smbus.read_write == I2C_SMBUS_WRITE);
+	if (!noData && !smbus.data) {
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
+
+	union i2c_smbus_data data;
+	std::memset(&data, 0, sizeof(data));
+	size_t dataSize = 0;
+	bool dataIn = false;
+	bool dataOut = false;
+	if (!noData) {
+		if (size == I2C_SMBUS_BYTE_DATA || size == I2C_SMBUS_BYTE) {
+			dataSize = sizeof(data.byte);
+		} else if (size == I2C_SMBUS_WORD_DATA
+				|| size == I2C_SMBUS_PROC_CALL) {
+			dataSize = sizeof(data.word);
+		} else {
+			dataSize = sizeof(data.block);
+		}
+		dataIn = smbus.read_write == I2C_SMBUS_WRITE
+				|| size == I2C_SMBUS_PROC_CALL
+				|| size == I2C_SMBUS_BLOCK_PROC_CALL
+				|| size == I2C_SMBUS_I2C_BLOCK_DATA;
+		dataOut = smbus.read_write == I2C_SMBUS_READ
+				|| size == I2C_SMBUS_PROC_CALL
+				|| size == I2C_SMBUS_BLOCK_PROC_CALL;
+		if (dataIn) {
+			in.push_back({ smbus.data, dataSize });
+		}
+		if (dataOut) {
+			out.push_back({ smbus.data, dataSize });
+		}
+		if ((dataIn && inSize < sizeof(smbus) + dataSize)
+				|| (dataOut && outSize < dataSize)) {
+			fuse_reply_ioctl_retry(req, in.data(), in.size(),
+					out.data(), out.size());
+			return;
+		}
+		if (dataIn) {
+			std::memcpy(&data, (const char*)inBuf + sizeof(smbus), dataSize);
+		}
+	}
+	if (size == I2C_SMBUS_I2C_BLOCK_BROKEN) {
+		size = I2C_SMBUS_I2C_BLOCK_DATA;
+		if (smbus.read_write == I2C_SMBUS_READ) {
+			data.block[0] = I2C_SMBUS_BLOCK_MAX;
+		}
+	}
+
+	int ret = busOf(req).smbus(client.addr, client.tenBit ? I2C_M_TEN : 0,
+			client.pec, smbus.read_write, smbus.command, size, &data);
+	if (ret < 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	fuse_reply_ioctl(req, 0, dataOut ? &data : nullptr,
+			dataOut ? dataSize : 0);
+}
+
+static void cuseIoctl(fuse_req_t req, int cmd, void *arg,
+		struct fuse_file_info *fi, unsigned int flags, const void *inBuf,
+		size_t inSize, size_t outSize) {
+	Client& client = clientOf(fi);
+	unsigned long value = (unsigned long)arg;
+
+	if (flags & FUSE_IOCTL_COMPAT) {
+		fuse_reply_err(req, ENOSYS);
+		return;
+	}
+
+	switch ((unsigned int)cmd) {
+	case I2C_SLAVE:
+	case I2C_SLAVE_FORCE:
+		if (value > 0x3ff || (!client.tenBit && value > 0x7f)) {
+			fuse_reply_err(req, EINVAL);
+			return;
+		}
+		client.addr = value;
+		break;
+
+	case I2C_TENBIT:
+		client.tenBit = value != 0;
+		break;
+
+	case I2C_PEC:
+		client.pec = value != 0;
+		break;
+
+	case I2C_FUNCS: {
+		unsigned long funcs = sim::Bus::functionality();
+		if (outSize < sizeof(funcs)) {
+			struct iovec out = { arg, sizeof(funcs) };
+			fuse_reply_ioctl_retry(req, nullptr, 0, &out, 1);
+			return;
+		}
+		fuse_reply_ioctl(req, 0, &funcs, sizeof(funcs));
+		return;
+	}
+
+	case I2C_RDWR:
+		ioctlRdwr(req, arg, inBuf, inSize, outSize);
+		return;
+
+	case I2C_SMBUS:
+		ioctlSmbus(req, client, arg, inBuf, inSize, outSize);
+		return;
+
+	case I2C_RETRIES:
+		// Retries don't happen
+		break;
+
+	case I2C_TIMEOUT:
+		if (value > INT_MAX) {
+			fuse_reply_err(req, EINVAL);
+			return;
+		}
+		break;
+
+	default:
+		fuse_reply_err(req, ENOTTY);
+		return;
+	}
+	fuse_reply_ioctl(req, 0, nullptr, 0);
+}
+
+/**
+ * Adds the attributes of the kernel modules that are used by the
+ * tests, i.e. those of the hub and of the DS1621s attached to it.
+ */
+static void addAttributes(SysFs& sysFs, sim::Bus& bus,
+		std::vector<sim::Ds1621Device>& ds1621s) {
+	sim::Hub& hub = bus.hub();
+	std::string hubDir = "devices/i2c-" + std::to_string(hub.number());
+
+	sysFs.addLink("bus/i2c/devices/i2c-" + std::to_string(hub.number()),
+			"../../../" + hubDir);
+	sysFs.addAttribute(hubDir + "/pec_inject", {
+		[&bus, &hub] {
+			return bus.locked([&hub] {
+				std::string res;
+				char line[16];
+				for (int addr = 0; addr < sim::Hub::addrs; addr++) {
+					if (hub.pecErrors[addr]) {
+						std::snprintf(line, sizeof(line), "0x%02x %u\n",
+								addr, hub.pecErrors[addr]);
+						res += line;
+					}
+				}
+				return res;
+			});
+		},
+		[&bus, &hub](const std::string& data) {
+			unsigned int addr, errors;
+			if (std::sscanf(data.c_str(), "%i %u", &addr, &errors) != 2
+					|| addr >= sim::Hub::addrs || errors > UINT8_MAX) {
+				return -EINVAL;
+			}
+			bus.locked([&] { hub.pecErrors[addr] = errors; });
+			return 0;
+		}
+	});
+
+	for (sim::Ds1621Device& device : ds1621s) {
+		if (device.hub != hub.number()) {
+			continue;
+		}
+		char name[16];
+		std::snprintf(name, sizeof(name), "/%d-%04x", device.hub,
+				0x1000 | device.addr);
+		std::string dir = hubDir + name;
+		sim::Ds1621 *ds1621 = device.model.get();
+		sysFs.addAttribute(dir + "/temperature", {
+			[&bus, ds1621] {
+				return std::to_string(bus.locked([ds1621] {
+					return ds1621->temperature(); })) + "\n";
+			},
+			[&bus, ds1621](const std::string& data) {
+				char *end;
+				long value = std::strtol(data.c_str(), &end, 10);
+				if (end == data.c_str()) {
+					return -EINVAL;
+				}
+				bus.locked([&] { ds1621->setTemperature(value); });
+				return 0;
+			}
+		});
+		sysFs.addAttribute(dir + "/tout", { [&bus, ds1621] {
+			return std::to_string(bus.locked([ds1621] {
+				return ds1621->tout(); })) + "\n";
+		} });
+		sysFs.addAttribute(dir + "/thf", { [&bus, ds1621] {
+			return std::to_string(bus.locked([ds1621] {
+				return (int)ds1621->thf(); })) + "\n";
+		} });
+		sysFs.addAttribute(dir + "/tlf", { [&bus, ds1621] {
+			return std::to_string(bus.locked([ds1621] {
+				return (int)ds1621->tlf(); })) + "\n";
+		} });
+		ds1621->onSignals = [&sysFs, dir](uint8_t changed) {
+			if (changed & sim::Ds1621::signalTout) {
+				sysFs.notify(dir + "/tout");
+			}
+			if (changed & sim::Ds1621::signalThf) {
+				sysFs.notify(dir + "/thf");
+			}
+			if (changed & sim::Ds1621::signalTlf) {
+				sysFs.notify(dir + "/tlf");
+			}
+		};
+	}
+
+	// The driver's bulk update of all DS1621s
+	sysFs.addAttribute("bus/i2c/drivers/i2c-slave-ds1621/temperatures", {
+		nullptr,
+		[&bus, &ds1621s](const std::string& data) {
+			struct {
+				uint16_t adapter;
+				uint16_t addr;
+				int32_t temperature;
+			} record;
+			if (data.size() % sizeof(record)) {
+				return -EINVAL;
+			}
+			bus.locked([&] {
+				for (size_t offset = 0; offset < data.size();
+						offset += sizeof(record)) {
+					std::memcpy(&record, data.data() + offset, sizeof(record));
+					for (sim::Ds1621Device& device : ds1621s) {
+						if (device.hub == record.adapter
+								&& device.addr == record.addr) {
+							device.model->setTemperature(record.temperature);
+						}
+					}
+				}
+			});
+			return 0;
+		}
+	});
+}
+
+static void usage(const char *name) {
+	std::cerr << "Usage: " << name << " [-d] [-n bus] [-m mountpoint]"
+			<< std::endl;
+}
+
+int main(int argc, char **argv) {
+	int busNum = -1;
+	std::string mountPoint;
+	bool debug = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "dn:m:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			debug = true;
+			break;
+		case 'n':
+			busNum = std::atoi(optarg);
+			break;
+		case 'm':
+			mountPoint = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (busNum < 0) {
+		// First free number, leaving one for the (virtual) hub
+		busNum = 1;
+		while (access(("/dev/i2c-" + std::to_string(busNum - 1)).c_str(),
+				F_OK) == 0 || access(("/dev/i2c-"
+						+ std::to_string(busNum)).c_str(), F_OK) == 0) {
+			busNum++;
+		}
+	}
+
+	sim::Bus bus(busNum);
+	std::vector<sim::Ds1621Device> ds1621s = sim::attachTestDevices(bus);
+	SysFs sysFs;
+	addAttributes(sysFs, bus, ds1621s);
+
+	std::string devName = "DEVNAME=i2c-" + std::to_string(busNum);
+	const char *devInfo[] = { devName.c_str() };
+	struct cuse_info info;
+	std::memset(&info, 0, sizeof(info));
+	info.dev_info_argc = 1;
+	info.dev_info_argv = devInfo;
+	info.flags = CUSE_UNRESTRICTED_IOCTL;
+
+	struct cuse_lowlevel_ops ops;
+	std::memset(&ops, 0, sizeof(ops));
+	ops.open = cuseOpen;
+	ops.release = cuseRelease;
+	ops.read = cuseRead;
+	ops.write = cuseWrite;
+	ops.ioctl = cuseIoctl;
+
+	// Always in the foreground and multi-threaded
+	std::vector<const char*> cuseArgv { argv[0], "-f" };
+	if (debug) {
+		cuseArgv.push_back("-d");
+	}
+	int multithreaded;
+	struct fuse_session *session = cuse_lowlevel_setup(cuseArgv.size(),
+			const_cast<char**>(cuseArgv.data()), &info, &ops,
+			&multithreaded, &bus);
+	if (!session) {
+		std::cerr << "Cannot create /dev/i2c-" << busNum << std::endl;
+		return 1;
+	}
+	if (!mountPoint.empty() && !sysFs.start(mountPoint, debug)) {
+		std::cerr << "Cannot mount " << mountPoint << std::endl;
+		cuse_lowlevel_teardown(session);
+		return 1;
+	}
+	std::cout << "Created master /dev/i2c-" << busNum << std::endl;
+
+	int res = fuse_session_loop_mt(session, 0);
+	sysFs.stop();
+	cuse_lowlevel_teardown(session);
+	return res == 0 ? 0 : 1;
+}
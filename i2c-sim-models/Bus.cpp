@@ -0,0 +1,278 @@
+/*
+ * Bus.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Bus.h"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+namespace sim {
+
+/** CRC-8 polynomial x^8 + x^2 + x + 1 as used by SMBus */
+static constexpr uint8_t pecPoly = 0x07;
+
+static const std::array<uint8_t, 256> pecTable = [] {
+	std::array<uint8_t, 256> table {};
+	for (unsigned int i = 0; i < 256; i++) {
+		uint8_t crc = i;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ pecPoly : crc << 1;
+		}
+		table[i] = crc;
+	}
+	return table;
+}();
+
+static uint8_t pecUpdate(uint8_t crc, const uint8_t *buf, std::size_t len) {
+	while (len--) {
+		crc = pecTable[crc ^ *buf++];
+	}
+	return crc;
+}
+
+/**
+ * Handles a single message.
+ */
+static int xfer(Slave& slave, struct i2c_msg& msg) {
+	uint8_t value = 0;
+
+	if (msg.flags & I2C_M_RD) {
+		slave.event(SlaveEvent::ReadRequested, value);
+		msg.buf[0] = value;
+		if (msg.flags & I2C_M_RECV_LEN) {
+			// First byte is the number of bytes that follow
+			if (value == 0 || value > I2C_SMBUS_BLOCK_MAX) {
+				slave.event(SlaveEvent::Stop, value);
+				return -EPROTO;
+			}
+			msg.len += value;
+		}
+		for (int i = 1; i < msg.len; i++) {
+			slave.event(SlaveEvent::ReadProcessed, value);
+			msg.buf[i] = value;
+		}
+	} else {
+		slave.event(SlaveEvent::WriteRequested, value);
+		for (int i = 0; i < msg.len; i++) {
+			value = msg.buf[i];
+			slave.event(SlaveEvent::WriteReceived, value);
+		}
+	}
+	slave.event(SlaveEvent::Stop, value);
+	return 0;
+}
+
+uint32_t Bus::functionality() {
+	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL
+			| I2C_FUNC_SMBUS_READ_BLOCK_DATA
+			| I2C_FUNC_SMBUS_BLOCK_PROC_CALL
+			| I2C_FUNC_SMBUS_PEC;
+}
+
+/**
+ * Returns the PEC as received by the other side, corrupted if
+ * errors are to be injected for the slave.
+ */
+static uint8_t pecTransmit(Hub& hub, uint16_t addr, uint8_t pec) {
+	if (hub.pecErrors[addr] == 0) {
+		return pec;
+	}
+	hub.pecErrors[addr] -= 1;
+	return ~pec;
+}
+
+int Bus::transferLocked(struct i2c_msg *msgs, int num, bool pec) {
+	uint8_t crc = 0;
+
+	for (int i = 0; i < num; i++) {
+		// Find slave (multiplexer settings may have changed)
+		Hub *hub = nullptr;
+		Slave *slave = (msgs[i].flags & I2C_M_TEN) ? nullptr
+				: root.find(msgs[i].addr, &hub);
+		if (!slave) {
+			return -ENODEV;
+		}
+		uint8_t addr = msgs[i].addr << 1 | !!(msgs[i].flags & I2C_M_RD);
+		bool pecFollows = pec && i == num - 1;
+		if (pec) {
+			crc = pecUpdate(crc, &addr, 1);
+		}
+
+		if (!(msgs[i].flags & I2C_M_RD)) {
+			if (pec) {
+				crc = pecUpdate(crc, msgs[i].buf, msgs[i].len);
+			}
+			// The slave discards the command if the PEC doesn't match
+			if (pecFollows && pecTransmit(*hub, msgs[i].addr, crc) != crc) {
+				return -EIO;
+			}
+		}
+
+		int ret = xfer(*slave, msgs[i]);
+		if (ret < 0) {
+			return ret;
+		}
+
+		if (msgs[i].flags & I2C_M_RD) {
+			if (pec) {
+				crc = pecUpdate(crc, msgs[i].buf, msgs[i].len);
+			}
+			// The slave sends the PEC following the last message
+			if (pecFollows && pecTransmit(*hub, msgs[i].addr, crc) != crc) {
+				return -EBADMSG;
+			}
+		}
+	}
+	return num;
+}
+
+int Bus::transfer(struct i2c_msg *msgs, int num) {
+	std::lock_guard<std::mutex> guard(mutex);
+	return transferLocked(msgs, num, false);
+}
+
+/**
+ * Converts the command to messages as i2c-core's emulation does.
+ * The PEC isn't added to the messages, it is handled by the
+ * transfer (for the commands that support it).
+ */
+int Bus::smbus(uint16_t addr, uint16_t flags, bool pec, char readWrite,
+		uint8_t command, int size, union i2c_smbus_data *data) {
+	uint8_t out[I2C_SMBUS_BLOCK_MAX + 3];
+	uint8_t in[I2C_SMBUS_BLOCK_MAX + 2];
+	uint16_t msgFlags = flags & I2C_M_TEN;
+	struct i2c_msg msgs[2] = {
+		{ addr, msgFlags, 1, out },
+		{ addr, (uint16_t)(msgFlags | I2C_M_RD), 0, in },
+	};
+	bool read = readWrite == I2C_SMBUS_READ;
+	int num = read ? 2 : 1;
+
+	// As with i2c-core, these commands are executed without PEC
+	if (size == I2C_SMBUS_QUICK || size == I2C_SMBUS_I2C_BLOCK_DATA) {
+		pec = false;
+	}
+
+	out[0] = command;
+	switch (size) {
+	case I2C_SMBUS_QUICK:
+		msgs[0].len = 0;
+		msgs[0].flags = msgFlags | (read ? I2C_M_RD : 0);
+		num = 1;
+		break;
+
+	case I2C_SMBUS_BYTE:
+		if (read) {
+			// Read byte without command
+			msgs[0] = msgs[1];
+			msgs[0].len = 1;
+			num = 1;
+		}
+		break;
+
+	case I2C_SMBUS_BYTE_DATA:
+		if (read) {
+			msgs[1].len = 1;
+		} else {
+			msgs[0].len = 2;
+			out[1] = data->byte;
+		}
+		break;
+
+	case I2C_SMBUS_WORD_DATA:
+		if (read) {
+			msgs[1].len = 2;
+		} else {
+			msgs[0].len = 3;
+			out[1] = data->word & 0xff;
+			out[2] = data->word >> 8;
+		}
+		break;
+
+	case I2C_SMBUS_PROC_CALL:
+		num = 2;
+		read = true;
+		msgs[0].len = 3;
+		out[1] = data->word & 0xff;
+		out[2] = data->word >> 8;
+		msgs[1].len = 2;
+		break;
+
+	case I2C_SMBUS_BLOCK_DATA:
+		if (read) {
+			msgs[1].flags |= I2C_M_RECV_LEN;
+			msgs[1].len = 1;
+		} else {
+			if (data->block[0] == 0 || data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+				return -EINVAL;
+			}
+			msgs[0].len = data->block[0] + 2;
+			std::memcpy(out + 1, data->block, msgs[0].len - 1);
+		}
+		break;
+
+	case I2C_SMBUS_BLOCK_PROC_CALL:
+		if (data->block[0] == 0 || data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+			return -EINVAL;
+		}
+		num = 2;
+		read = true;
+		msgs[0].len = data->block[0] + 2;
+		std::memcpy(out + 1, data->block, msgs[0].len - 1);
+		msgs[1].flags |= I2C_M_RECV_LEN;
+		msgs[1].len = 1;
+		break;
+
+	case I2C_SMBUS_I2C_BLOCK_DATA:
+		if (data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+			return -EINVAL;
+		}
+		if (read) {
+			msgs[1].len = data->block[0];
+		} else {
+			msgs[0].len = data->block[0] + 1;
+			std::memcpy(out + 1, data->block + 1, data->block[0]);
+		}
+		break;
+
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	std::lock_guard<std::mutex> guard(mutex);
+	int ret = transferLocked(msgs, num, pec);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (read) {
+		switch (size) {
+		case I2C_SMBUS_BYTE:
+		case I2C_SMBUS_BYTE_DATA:
+			data->byte = in[0];
+			break;
+
+		case I2C_SMBUS_WORD_DATA:
+		case I2C_SMBUS_PROC_CALL:
+			data->word = in[0] | (in[1] << 8);
+			break;
+
+		case I2C_SMBUS_BLOCK_DATA:
+		case I2C_SMBUS_BLOCK_PROC_CALL:
+			std::memcpy(data->block, in, in[0] + 1);
+			break;
+
+		case I2C_SMBUS_I2C_BLOCK_DATA:
+			std::memcpy(data->block + 1, in, data->block[0]);
+			break;
+		}
+	}
+	return 0;
+}
+
+}
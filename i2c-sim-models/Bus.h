@@ -0,0 +1,74 @@
+/*
+ * Bus.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_SIM_MODELS_BUS_H_
+#define I2C_SIM_MODELS_BUS_H_
+
+#include <cstdint>
+#include <mutex>
+#include <linux/i2c.h>
+
+#include "Hub.h"
+
+namespace sim {
+
+/**
+ * The master that accesses the slaves attached to a hub. The
+ * transfers are handled as by the kernel module's master, including
+ * the SMBus commands with PEC. SMBus commands without PEC are
+ * emulated as by i2c-core. Methods return negative errno values
+ * on error, like their kernel counterparts.
+ *
+ * A mutex serializes the transfers. Accesses to the models by
+ * other means (e.g. setting a sensor value) must use locked().
+ */
+class Bus {
+public:
+	/**
+	 * Creates a bus with the given number. The hub gets the
+	 * preceding number.
+	 */
+	explicit Bus(int number) : num(number), root(number - 1) {}
+
+	int number() const { return num; }
+	Hub& hub() { return root; }
+
+	static uint32_t functionality();
+
+	/**
+	 * Executes the messages as a combined transfer. Returns the
+	 * number of messages executed. Messages with I2C_M_RECV_LEN
+	 * must have a length of 1, the length is increased by the
+	 * number of bytes received.
+	 */
+	int transfer(struct i2c_msg *msgs, int num);
+
+	/**
+	 * Executes an SMBus command. The flags are message flags
+	 * (I2C_M_TEN), pec enables packet error checking.
+	 */
+	int smbus(uint16_t addr, uint16_t flags, bool pec, char readWrite,
+			uint8_t command, int size, union i2c_smbus_data *data);
+
+	/** Invokes the function with the bus locked. */
+	template<typename Function>
+	auto locked(Function function) {
+		std::lock_guard<std::mutex> guard(mutex);
+		return function();
+	}
+
+private:
+	int num;
+	Hub root;
+	std::mutex mutex;
+
+	int transferLocked(struct i2c_msg *msgs, int num, bool pec);
+};
+
+}
+
+#endif /* I2C_SIM_MODELS_BUS_H_ */
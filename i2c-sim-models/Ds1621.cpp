@@ -0,0 +1,160 @@
+/*
+ * Ds1621.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Ds1621.h"
+
+#include <cstdlib>
+
+namespace sim {
+
+static constexpr uint8_t acPol = 0x02;
+static constexpr uint8_t ac1Shot = 0x01;
+
+/**
+ * Convert internal value representation (MSB integer part,
+ * LSB 0,5) to m°C.
+ */
+static int leftAlignedToInt(int16_t value) {
+	return (value >> 7) * 500;
+}
+
+int Ds1621::tout() const {
+	return (ac & acPol) ? toutActive : 1 - toutActive;
+}
+
+uint8_t Ds1621::signalState() const {
+	return (ac & (signalThf | signalTlf)) | tout();
+}
+
+void Ds1621::notifySignals(uint8_t before) {
+	uint8_t changed = before ^ signalState();
+
+	if (changed && onSignals) {
+		onSignals(changed);
+	}
+}
+
+/**
+ * Update the measured temperature. Apart from setting the value,
+ * this function adjusts the flags in AC and toutActive.
+ */
+void Ds1621::updateTemperature(int value) {
+	uint8_t before = signalState();
+
+	measuredTemperature = value;
+	if (value >= leftAlignedToInt(th)) {
+		ac |= signalThf;
+		toutActive = 1;
+	}
+	if (value <= leftAlignedToInt(tl)) {
+		ac |= signalTlf;
+	}
+	if (value < leftAlignedToInt(tl)) {
+		toutActive = 0;
+	}
+	notifySignals(before);
+}
+
+void Ds1621::setTemperature(int value) {
+	storedTemperature = value;
+	if (convertingContinuously) {
+		updateTemperature(value);
+	}
+}
+
+void Ds1621::handleCommand(uint8_t cmd) {
+	int fracDelta;
+
+	pending = 1;
+	switch (cmd) {
+	case 0xa1: // Access TH
+		pending = 2;
+		buffer = th;
+		writeTarget = &th;
+		break;
+	case 0xa2: // Access TL
+		pending = 2;
+		buffer = tl;
+		writeTarget = &tl;
+		break;
+	case 0xac: // Access Config
+		buffer = ac | 0x8;
+		writeTarget = &ac;
+		break;
+	case 0xa8: // Read Counter
+		buffer = readCounter;
+		break;
+	case 0xa9: // Read Slope
+		buffer = readSlope;
+		break;
+	case 0xaa: // Read Temperature
+		pending = 2;
+		buffer = (measuredTemperature <= 0 ? -1 : 1)
+				* ((std::abs(measuredTemperature) + 250) / 500) << 7;
+		fracDelta = measuredTemperature - (int8_t)(buffer >> 8) * 1000;
+		readSlope = 255;
+		readCounter = (750 - fracDelta) * readSlope / 1000;
+		break;
+	case 0xee: // Start Convert T
+		updateTemperature(storedTemperature);
+		if (!(ac & ac1Shot)) {
+			convertingContinuously = true;
+		}
+		break;
+	case 0x22: // Stop Convert T
+		convertingContinuously = false;
+		break;
+	default:
+		pending = 0;
+		break;
+	}
+}
+
+void Ds1621::event(SlaveEvent event, uint8_t& val) {
+	uint8_t before;
+
+	switch (event) {
+	case SlaveEvent::WriteReceived:
+		if (pending == 0) {
+			handleCommand(val);
+			break;
+		}
+		buffer = (buffer << 8) | val;
+		if (--pending > 0) {
+			break;
+		}
+		if (writeTarget == &th || writeTarget == &tl) {
+			*static_cast<int16_t*>(writeTarget) = buffer;
+			// Maybe adjust flags
+			if (convertingContinuously) {
+				updateTemperature(measuredTemperature);
+			}
+		} else if (writeTarget == &ac) {
+			// Writing AC may change POL or clear flags
+			before = signalState();
+			ac = buffer;
+			notifySignals(before);
+		}
+		break;
+
+	case SlaveEvent::ReadRequested:
+	case SlaveEvent::ReadProcessed:
+		if (pending > 0) {
+			val = buffer >> (--pending * 8);
+		}
+		break;
+
+	case SlaveEvent::WriteRequested:
+		pending = 0;
+		break;
+
+	default:
+		break;
+	}
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * Ds1621.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_SIM_MODELS_DS1621_H_
+#define I2C_SIM_MODELS_DS1621_H_
+
+#include <functional>
+
+#include "Slave.h"
+
+namespace sim {
+
+/**
+ * A DS1621 that behaves like the kernel module i2c-slave-ds1621.
+ */
+class Ds1621 : public Slave {
+public:
+	/** Signals as passed to onSignals. */
+	static constexpr uint8_t signalTout = 0x01;
+	static constexpr uint8_t signalThf = 0x40;
+	static constexpr uint8_t signalTlf = 0x20;
+
+	void event(SlaveEvent event, uint8_t& val) override;
+
+	/** The "sensor" temperature in m°C. */
+	int temperature() const { return storedTemperature; }
+	/**
+	 * Sets the sensor temperature. The measured temperature is
+	 * updated as well if converting continuously.
+	 */
+	void setTemperature(int value);
+
+	/** The logical value of the Tout pin. */
+	int tout() const;
+	bool thf() const { return ac & signalThf; }
+	bool tlf() const { return ac & signalTlf; }
+
+	/**
+	 * Invoked with the signals that have changed (with the bus
+	 * locked).
+	 */
+	std::function<void(uint8_t changed)> onSignals;
+
+private:
+	int storedTemperature = 21000;
+	int measuredTemperature = 0;
+	int16_t tl = 0;
+	int16_t th = 0;
+	uint8_t ac = 0;
+	uint8_t toutActive = 0;
+	uint8_t readCounter = 0;
+	uint8_t readSlope = 0;
+	uint16_t buffer = 0;
+	uint8_t pending = 0;
+	void *writeTarget = nullptr;
+	bool convertingContinuously = false;
+
+	uint8_t signalState() const;
+	void notifySignals(uint8_t before);
+	void updateTemperature(int value);
+	void handleCommand(uint8_t cmd);
+};
+
+}
+
+#endif /* I2C_SIM_MODELS_DS1621_H_ */
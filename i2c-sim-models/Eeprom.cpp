@@ -0,0 +1,45 @@
+/*
+ * Eeprom.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Eeprom.h"
+
+namespace sim {
+
+Eeprom::Eeprom(std::size_t size, int addressBytes)
+	: buffer(size), addressMask(size - 1), addressBytes(addressBytes) {
+}
+
+void Eeprom::event(SlaveEvent event, uint8_t& val) {
+	switch (event) {
+	case SlaveEvent::WriteReceived:
+		if (addressReceived < addressBytes) {
+			if (addressReceived == 0) {
+				index = 0;
+			}
+			index = val | (index << 8);
+			addressReceived++;
+		} else {
+			buffer[index++ & addressMask] = val;
+		}
+		break;
+
+	case SlaveEvent::ReadProcessed:
+		// The previous byte made it to the bus, get next one
+		index++;
+		/* fall through */
+	case SlaveEvent::ReadRequested:
+		val = buffer[index & addressMask];
+		break;
+
+	case SlaveEvent::Stop:
+	case SlaveEvent::WriteRequested:
+		addressReceived = 0;
+		break;
+	}
+}
+
+}
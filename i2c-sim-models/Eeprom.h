@@ -0,0 +1,49 @@
+/*
+ * Eeprom.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_SIM_MODELS_EEPROM_H_
+#define I2C_SIM_MODELS_EEPROM_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "Slave.h"
+
+namespace sim {
+
+/**
+ * A 24Cxx EEPROM that behaves like the kernel's i2c-slave-eeprom.
+ * The first (one or two) bytes written set the address, further
+ * bytes are stored without regard to pages. Reading starts at the
+ * current address. As with the kernel's slave, the address isn't
+ * advanced past the last byte read.
+ */
+class Eeprom : public Slave {
+public:
+	Eeprom(std::size_t size, int addressBytes);
+
+	static std::shared_ptr<Eeprom> at24c02() {
+		return std::make_shared<Eeprom>(256, 1);
+	}
+	static std::shared_ptr<Eeprom> at24c32() {
+		return std::make_shared<Eeprom>(4096, 2);
+	}
+
+	void event(SlaveEvent event, uint8_t& val) override;
+
+private:
+	std::vector<uint8_t> buffer;
+	unsigned int addressMask;
+	int addressBytes;
+	int addressReceived = 0;
+	unsigned int index = 0;
+};
+
+}
+
+#endif /* I2C_SIM_MODELS_EEPROM_H_ */
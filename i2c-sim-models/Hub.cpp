@@ -0,0 +1,58 @@
+/*
+ * Hub.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Hub.h"
+
+#include <stdexcept>
+
+#include "Mux.h"
+
+namespace sim {
+
+void Hub::attach(uint16_t addr, std::shared_ptr<Slave> slave) {
+	if (addr >= addrs) {
+		throw std::invalid_argument("Invalid address");
+	}
+	if (slaves[addr]) {
+		throw std::invalid_argument("Address in use");
+	}
+	Mux *mux = dynamic_cast<Mux*>(slave.get());
+	if (mux) {
+		muxes.push_back(mux);
+	}
+	slaves[addr] = std::move(slave);
+}
+
+Slave* Hub::slave(uint16_t addr) const {
+	return addr < addrs ? slaves[addr].get() : nullptr;
+}
+
+Slave* Hub::find(uint16_t addr, Hub **owner) {
+	if (addr >= addrs) {
+		return nullptr;
+	}
+	if (slaves[addr]) {
+		if (owner) {
+			*owner = this;
+		}
+		return slaves[addr].get();
+	}
+	for (Mux *mux : muxes) {
+		for (int chan = 0; chan < mux->channels(); chan++) {
+			if (!(mux->control() & (1 << chan))) {
+				continue;
+			}
+			Slave *slave = mux->channel(chan).find(addr, owner);
+			if (slave) {
+				return slave;
+			}
+		}
+	}
+	return nullptr;
+}
+
+}
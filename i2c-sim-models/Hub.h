@@ -0,0 +1,66 @@
+/*
+ * Hub.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_SIM_MODELS_HUB_H_
+#define I2C_SIM_MODELS_HUB_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Slave.h"
+
+namespace sim {
+
+class Mux;
+
+/**
+ * The slaves attached to the bus (or to a channel of a multiplexer).
+ * Hubs have numbers that correspond to the adapter numbers of the
+ * kernel module's hubs.
+ */
+class Hub {
+public:
+	static constexpr int addrs = 128;
+
+	explicit Hub(int number) : num(number) {}
+	Hub(const Hub&) = delete;
+	Hub& operator=(const Hub&) = delete;
+
+	int number() const { return num; }
+
+	/**
+	 * Attaches the slave with the given (7-bit) address. Throws
+	 * std::invalid_argument if the address is invalid or in use.
+	 */
+	void attach(uint16_t addr, std::shared_ptr<Slave> slave);
+
+	/** Returns the slave attached with the given address or nullptr. */
+	Slave* slave(uint16_t addr) const;
+
+	/**
+	 * Finds the slave with the given address. Slaves attached
+	 * directly take precedence, then the enabled channels of the
+	 * multiplexers are searched in the order of attachment and
+	 * of the channel number. If owner is given, it is set to the
+	 * hub that the slave is attached to.
+	 */
+	Slave* find(uint16_t addr, Hub **owner = nullptr);
+
+	/** The number of PEC errors to inject, indexed by address. */
+	std::array<uint8_t, addrs> pecErrors {};
+
+private:
+	int num;
+	std::array<std::shared_ptr<Slave>, addrs> slaves;
+	std::vector<Mux*> muxes;
+};
+
+}
+
+#endif /* I2C_SIM_MODELS_HUB_H_ */
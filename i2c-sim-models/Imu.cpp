@@ -0,0 +1,254 @@
+/*
+ * Imu.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Imu.h"
+
+namespace sim {
+
+// Registers
+static constexpr uint8_t regFifoCtrl1 = 0x07;
+static constexpr uint8_t regFifoCtrl2 = 0x08;
+static constexpr uint8_t regFifoCtrl4 = 0x0a;
+static constexpr uint8_t regWhoAmI = 0x0f;
+static constexpr uint8_t regCtrl1 = 0x10;
+static constexpr uint8_t regCtrl3 = 0x12;
+static constexpr uint8_t regFifoStatus1 = 0x3a;
+static constexpr uint8_t regFifoStatus2 = 0x3b;
+static constexpr uint8_t regFifoDataOut = 0x3e;
+
+static constexpr uint8_t whoAmI = 0x6c;
+
+static constexpr uint8_t ctrl3SwReset = 1 << 0;
+static constexpr uint8_t ctrl3IfInc = 1 << 2;
+
+static constexpr uint8_t fifoModeBypass = 0;
+static constexpr uint8_t fifoModeFifo = 1;
+static constexpr uint8_t fifoModeContinuous = 6;
+
+static constexpr uint8_t status2Wtm = 1 << 7;
+static constexpr uint8_t status2Ovr = 1 << 6;
+static constexpr uint8_t status2Full = 1 << 5;
+static constexpr uint8_t status2Empty = 1 << 4;
+
+static constexpr uint64_t fifoSize = 512;
+
+/** Sample periods (ns) for the ODR codes in CTRL1[7:4]. */
+static constexpr uint32_t odrPeriods[] = {
+	0, 80000000, 38461538, 19230769, 9615385, 4807692,
+	2403846, 1200480, 600240, 300120, 150060,
+};
+
+void Imu::generateSamples() {
+	if (period.count() == 0) {
+		return;
+	}
+	Clock::time_point now = Clock::now();
+	if (now < nextSample) {
+		return;
+	}
+	uint64_t due = (now - nextSample) / period + 1;
+	nextSample += due * period;
+
+	switch (fifoMode) {
+	case fifoModeFifo:
+		// Stops collecting when full
+		if (stopped) {
+			break;
+		}
+		if (due >= fifoSize - (gen - head)) {
+			stopped = true;
+			overrun = due > fifoSize - (gen - head);
+			due = fifoSize - (gen - head);
+		}
+		gen += due;
+		break;
+	case fifoModeContinuous:
+		// Overwrites the oldest samples when full
+		gen += due;
+		if (gen - head > fifoSize) {
+			head = gen - fifoSize;
+			overrun = true;
+		}
+		break;
+	default:
+		// Bypass, the FIFO isn't used
+		break;
+	}
+}
+
+void Imu::resetFifo() {
+	head = gen;
+	sampleLeft = 0;
+	overrun = false;
+	stopped = false;
+}
+
+void Imu::reset() {
+	ctrl1 = 0;
+	ctrl3 = ctrl3IfInc;
+	fifoMode = fifoModeBypass;
+	watermark = 0;
+	period = Clock::duration::zero();
+	resetFifo();
+}
+
+void Imu::setOdr(uint8_t value) {
+	unsigned int odr = value >> 4;
+
+	generateSamples();
+	ctrl1 = value;
+	period = std::chrono::duration_cast<Clock::duration>(
+			std::chrono::nanoseconds(odr < sizeof(odrPeriods)
+					/ sizeof(odrPeriods[0]) ? odrPeriods[odr] : 0));
+	nextSample = Clock::now() + period;
+}
+
+static void putWord(uint8_t *buf, int16_t value) {
+	buf[0] = value & 0xff;
+	buf[1] = (uint16_t)value >> 8;
+}
+
+/**
+ * Removes the oldest sample from the FIFO and makes it the sample
+ * being read.
+ */
+void Imu::popSample() {
+	uint32_t seq = head++;
+	uint32_t phase = seq & 0x3ff;
+	int16_t triangle = (phase < 0x200 ? phase : 0x3ff - phase) * 64 - 0x4000;
+
+	putWord(&sample[0], seq);
+	putWord(&sample[2], ~seq);
+	putWord(&sample[4], 0);
+	putWord(&sample[6], triangle);
+	putWord(&sample[8], -triangle);
+	putWord(&sample[10], 0x4000);
+	sampleLeft = sampleSize;
+}
+
+uint8_t Imu::readFifo() {
+	if (sampleLeft == 0) {
+		if (head == gen) {
+			generateSamples();
+			if (head == gen) {
+				return 0;
+			}
+		}
+		popSample();
+	}
+	return sample[sampleSize - sampleLeft--];
+}
+
+uint8_t Imu::readRegister(uint8_t reg) {
+	uint64_t diff = gen - head;
+	uint8_t value;
+
+	switch (reg) {
+	case regFifoCtrl1:
+		return watermark & 0xff;
+	case regFifoCtrl2:
+		return watermark >> 8;
+	case regFifoCtrl4:
+		return fifoMode;
+	case regWhoAmI:
+		return whoAmI;
+	case regCtrl1:
+		return ctrl1;
+	case regCtrl3:
+		return ctrl3;
+	case regFifoStatus1:
+		return diff & 0xff;
+	case regFifoStatus2:
+		value = (diff >> 8) & 0x03;
+		if (watermark && diff >= watermark) {
+			value |= status2Wtm;
+		}
+		if (overrun) {
+			value |= status2Ovr;
+			overrun = false;
+		}
+		if (diff == fifoSize) {
+			value |= status2Full;
+		}
+		if (diff == 0) {
+			value |= status2Empty;
+		}
+		return value;
+	case regFifoDataOut:
+		return readFifo();
+	default:
+		return 0;
+	}
+}
+
+void Imu::writeRegister(uint8_t reg, uint8_t value) {
+	switch (reg) {
+	case regFifoCtrl1:
+		watermark = (watermark & 0x100) | value;
+		break;
+	case regFifoCtrl2:
+		watermark = (watermark & 0xff) | ((value & 1) << 8);
+		break;
+	case regFifoCtrl4:
+		// Any mode change restarts the FIFO
+		generateSamples();
+		fifoMode = value & 0x07;
+		resetFifo();
+		break;
+	case regCtrl1:
+		setOdr(value);
+		break;
+	case regCtrl3:
+		if (value & ctrl3SwReset) {
+			reset();
+		} else {
+			ctrl3 = value;
+		}
+		break;
+	default:
+		// Read only or reserved
+		break;
+	}
+}
+
+void Imu::nextRegister() {
+	if (reg != regFifoDataOut && (ctrl3 & ctrl3IfInc)) {
+		reg++;
+	}
+}
+
+void Imu::event(SlaveEvent event, uint8_t& val) {
+	switch (event) {
+	case SlaveEvent::WriteReceived:
+		if (!addressed) {
+			reg = val;
+			addressed = true;
+		} else {
+			writeRegister(reg, val);
+			nextRegister();
+		}
+		break;
+
+	case SlaveEvent::ReadRequested:
+		// Status and data are up to date at the start of a read
+		generateSamples();
+		/* fall through */
+	case SlaveEvent::ReadProcessed:
+		val = readRegister(reg);
+		nextRegister();
+		break;
+
+	case SlaveEvent::WriteRequested:
+		addressed = false;
+		break;
+
+	default:
+		break;
+	}
+}
+
+}
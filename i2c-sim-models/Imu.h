@@ -0,0 +1,60 @@
+/*
+ * Imu.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_SIM_MODELS_IMU_H_
+#define I2C_SIM_MODELS_IMU_H_
+
+#include <chrono>
+
+#include "Slave.h"
+
+namespace sim {
+
+/**
+ * A FIFO based IMU that behaves like the kernel module
+ * i2c-slave-imu (see there for the registers). Samples are
+ * generated when the device is accessed.
+ */
+class Imu : public Slave {
+public:
+	Imu() { reset(); }
+
+	void event(SlaveEvent event, uint8_t& val) override;
+
+private:
+	using Clock = std::chrono::steady_clock;
+	static constexpr int sampleSize = 12;
+
+	uint8_t ctrl1;
+	uint8_t ctrl3;
+	uint8_t fifoMode;
+	uint16_t watermark;
+	Clock::duration period;
+	Clock::time_point nextSample;
+	uint64_t gen = 0;
+	uint64_t head = 0;
+	bool overrun;
+	bool stopped;
+	uint8_t sample[sampleSize];
+	uint8_t sampleLeft;
+	uint8_t reg = 0;
+	bool addressed = false;
+
+	void generateSamples();
+	void resetFifo();
+	void reset();
+	void setOdr(uint8_t value);
+	void popSample();
+	uint8_t readFifo();
+	uint8_t readRegister(uint8_t reg);
+	void writeRegister(uint8_t reg, uint8_t value);
+	void nextRegister();
+};
+
+}
+
+#endif /* I2C_SIM_MODELS_IMU_H_ */
@@ -0,0 +1,37 @@
+/*
+ * Mux.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Mux.h"
+
+namespace sim {
+
+Mux::Mux(int channels, int firstHub) {
+	for (int chan = 0; chan < channels; chan++) {
+		chans.emplace_back(new Hub(firstHub + chan));
+	}
+}
+
+/**
+ * The control register is written and read without a command byte.
+ */
+void Mux::event(SlaveEvent event, uint8_t& val) {
+	switch (event) {
+	case SlaveEvent::WriteReceived:
+		ctrl = val & ((1 << chans.size()) - 1);
+		break;
+
+	case SlaveEvent::ReadRequested:
+	case SlaveEvent::ReadProcessed:
+		val = ctrl;
+		break;
+
+	default:
+		break;
+	}
+}
+
+}
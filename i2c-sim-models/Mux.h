@@ -0,0 +1,41 @@
+/*
+ * Mux.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_SIM_MODELS_MUX_H_
+#define I2C_SIM_MODELS_MUX_H_
+
+#include <memory>
+#include <vector>
+
+#include "Hub.h"
+
+namespace sim {
+
+/**
+ * A PCA9548 (8 channels) or PCA9546 (4 channels) multiplexer. The
+ * channels are hubs numbered consecutively starting with the given
+ * number.
+ */
+class Mux : public Slave {
+public:
+	Mux(int channels, int firstHub);
+
+	void event(SlaveEvent event, uint8_t& val) override;
+
+	int channels() const { return chans.size(); }
+	Hub& channel(int chan) { return *chans.at(chan); }
+	/** The control register, bit n enables channel n. */
+	uint8_t control() const { return ctrl; }
+
+private:
+	std::vector<std::unique_ptr<Hub>> chans;
+	uint8_t ctrl = 0;
+};
+
+}
+
+#endif /* I2C_SIM_MODELS_MUX_H_ */
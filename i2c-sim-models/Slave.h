@@ -0,0 +1,38 @@
+/*
+ * Slave.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_SIM_MODELS_SLAVE_H_
+#define I2C_SIM_MODELS_SLAVE_H_
+
+#include <cstdint>
+
+namespace sim {
+
+/**
+ * The events passed to a slave, as defined by the kernel's
+ * slave interface.
+ */
+enum class SlaveEvent {
+	ReadRequested, WriteRequested, ReadProcessed, WriteReceived, Stop
+};
+
+/**
+ * A device model. The model is driven by the bus exactly as a
+ * kernel slave is driven by the virtual master, i.e. the event
+ * handler corresponds to the slave callback. All invocations
+ * are made with the bus locked.
+ */
+class Slave {
+public:
+	virtual ~Slave() = default;
+
+	virtual void event(SlaveEvent event, uint8_t& val) = 0;
+};
+
+}
+
+#endif /* I2C_SIM_MODELS_SLAVE_H_ */
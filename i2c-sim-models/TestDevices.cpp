@@ -0,0 +1,36 @@
+/*
+ * TestDevices.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "TestDevices.h"
+
+#include "Eeprom.h"
+#include "Imu.h"
+#include "Mux.h"
+
+namespace sim {
+
+std::vector<Ds1621Device> attachTestDevices(Bus& bus) {
+	Hub& hub = bus.hub();
+	std::vector<Ds1621Device> ds1621s;
+
+	hub.attach(0x50, Eeprom::at24c02());
+	hub.attach(0x51, Eeprom::at24c32());
+	ds1621s.push_back({ hub.number(), 0x48, std::make_shared<Ds1621>() });
+	hub.attach(0x48, ds1621s.back().model);
+	hub.attach(0x6a, std::make_shared<Imu>());
+
+	// The channel hubs follow the master's number
+	auto mux = std::make_shared<Mux>(8, bus.number() + 1);
+	hub.attach(0x70, mux);
+	Hub& channel = mux->channel(3);
+	ds1621s.push_back({ channel.number(), 0x4a, std::make_shared<Ds1621>() });
+	channel.attach(0x4a, ds1621s.back().model);
+
+	return ds1621s;
+}
+
+}
@@ -0,0 +1,37 @@
+/*
+ * TestDevices.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_SIM_MODELS_TESTDEVICES_H_
+#define I2C_SIM_MODELS_TESTDEVICES_H_
+
+#include <memory>
+#include <vector>
+
+#include "Bus.h"
+#include "Ds1621.h"
+
+namespace sim {
+
+/** A DS1621 attached to a hub. */
+struct Ds1621Device {
+	int hub;
+	uint16_t addr;
+	std::shared_ptr<Ds1621> model;
+};
+
+/**
+ * Attaches the devices that the setup-test target of the test
+ * project creates with the kernel modules: a 24C02 at 0x50,
+ * a 24C32 at 0x51, a DS1621 at 0x48, an IMU at 0x6a and a
+ * PCA9548 at 0x70 with a DS1621 at 0x4a on channel 3. Returns
+ * the DS1621s.
+ */
+std::vector<Ds1621Device> attachTestDevices(Bus& bus);
+
+}
+
+#endif /* I2C_SIM_MODELS_TESTDEVICES_H_ */
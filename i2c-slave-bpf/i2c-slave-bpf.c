@@ -0,0 +1,402 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * I2C slave mode device with a device model implemented in BPF
+ *
+ * Copyright (C) 2020 by Michael N. Lipp
+ */
+
+#define DEBUG 1
+#define pr_fmt(fmt) "i2c-slave-bpf: " fmt
+
+#include <linux/bpf.h>
+#include <linux/bpf_verifier.h>
+#include <linux/btf.h>
+#include <linux/i2c.h>
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+
+#define I2C_SLAVE_BPF_NAME_LEN 16
+
+/**
+ * The operations of a device model, implemented by BPF programs
+ * (struct_ops).
+ */
+struct i2c_slave_bpf_ops {
+	/**
+	 * Invoked for each slave event. "id" identifies the device
+	 * (adapter number in the upper 16 bits, address in the lower
+	 * 16 bits) and can be used as key for the device's state in
+	 * a BPF map. "val" is the byte received with
+	 * I2C_SLAVE_WRITE_RECEIVED. The value returned for the read
+	 * events (0-255) is sent to the master.
+	 */
+	int (*event)(u32 id, u32 event, u32 val);
+	/** The name used to select the model for a device. */
+	char name[I2C_SLAVE_BPF_NAME_LEN];
+};
+
+/**
+ * A registered model.
+ */
+struct bpf_model {
+	struct list_head node;
+	struct i2c_slave_bpf_ops *ops;
+};
+
+struct bpf_slave_data {
+	struct list_head node;
+	u32 id;
+	/** The name of the model selected with sysfs */
+	char model[I2C_SLAVE_BPF_NAME_LEN];
+	/** The model's operations if the model is registered */
+	struct i2c_slave_bpf_ops __rcu *ops;
+	/** Sysfs attribute for selecting the model */
+	struct device_attribute model_ac;
+};
+
+/** Protects models and slaves */
+static DEFINE_MUTEX(bpf_lock);
+static LIST_HEAD(bpf_models);
+static LIST_HEAD(bpf_slaves);
+
+/**
+ * Returns the registered operations for the model with the given
+ * name or NULL. Must be called with bpf_lock held.
+ */
+static struct i2c_slave_bpf_ops *findModel(const char *name) {
+	struct bpf_model *model;
+
+	list_for_each_entry(model, &bpf_models, node) {
+		if (strcmp(model->ops->name, name) == 0) {
+			return model->ops;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Makes all slaves that use the model with the given name use
+ * the given operations. Must be called with bpf_lock held.
+ */
+static void assignModel(const char *name, struct i2c_slave_bpf_ops *ops) {
+	struct bpf_slave_data *slave;
+
+	list_for_each_entry(slave, &bpf_slaves, node) {
+		if (strcmp(slave->model, name) == 0) {
+			rcu_assign_pointer(slave->ops, ops);
+		}
+	}
+}
+
+/**
+ * Slave callback routine. Passes the events to the model. Without
+ * model, the device behaves like an erased EEPROM.
+ */
+static int i2c_slave_bpf_slave_cb(struct i2c_client *client,
+				     enum i2c_slave_event event, u8 *val) {
+	struct bpf_slave_data *slave = i2c_get_clientdata(client);
+	struct i2c_slave_bpf_ops *ops;
+	int ret = 0xff;
+
+	rcu_read_lock();
+	ops = rcu_dereference(slave->ops);
+	if (ops) {
+		ret = ops->event(slave->id, event, *val);
+	}
+	rcu_read_unlock();
+
+	switch (event) {
+	case I2C_SLAVE_READ_REQUESTED:
+	case I2C_SLAVE_READ_PROCESSED:
+		*val = ret < 0 ? 0xff : ret;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * BPF struct_ops support.
+ */
+
+static int i2c_slave_bpf_ops_init(struct btf *btf) {
+	return 0;
+}
+
+static int i2c_slave_bpf_init_member(const struct btf_type *t,
+		const struct btf_member *member, void *kdata, const void *udata) {
+	const struct i2c_slave_bpf_ops *uops = udata;
+	struct i2c_slave_bpf_ops *ops = kdata;
+	u32 moff = __btf_member_bit_offset(t, member) / 8;
+
+	switch (moff) {
+	case offsetof(struct i2c_slave_bpf_ops, name):
+		if (!uops->name[0]
+				|| !memchr(uops->name, 0, sizeof(uops->name))) {
+			return -EINVAL;
+		}
+		strscpy(ops->name, uops->name, sizeof(ops->name));
+		return 1;
+	}
+	return 0;
+}
+
+static int i2c_slave_bpf_validate(void *kdata) {
+	struct i2c_slave_bpf_ops *ops = kdata;
+
+	return ops->event ? 0 : -EINVAL;
+}
+
+static int i2c_slave_bpf_reg(void *kdata, struct bpf_link *link) {
+	struct i2c_slave_bpf_ops *ops = kdata;
+	struct bpf_model *model;
+	int ret = 0;
+
+	model = kzalloc(sizeof(struct bpf_model), GFP_KERNEL);
+	if (!model) {
+		return -ENOMEM;
+	}
+	model->ops = ops;
+
+	mutex_lock(&bpf_lock);
+	if (findModel(ops->name)) {
+		kfree(model);
+		ret = -EEXIST;
+		goto unlock;
+	}
+	list_add_tail(&model->node, &bpf_models);
+	assignModel(ops->name, ops);
+	pr_debug("Registered model %s\n", ops->name);
+
+ unlock:
+	mutex_unlock(&bpf_lock);
+	return ret;
+}
+
+static void i2c_slave_bpf_unreg(void *kdata, struct bpf_link *link) {
+	struct i2c_slave_bpf_ops *ops = kdata;
+	struct bpf_model *model;
+
+	mutex_lock(&bpf_lock);
+	list_for_each_entry(model, &bpf_models, node) {
+		if (model->ops == ops) {
+			list_del(&model->node);
+			kfree(model);
+			break;
+		}
+	}
+	assignModel(ops->name, NULL);
+	pr_debug("Unregistered model %s\n", ops->name);
+	mutex_unlock(&bpf_lock);
+
+	// Wait for running callbacks
+	synchronize_rcu();
+}
+
+/**
+ * Replaces a model with a new implementation (using a link update).
+ */
+static int i2c_slave_bpf_update(void *kdata, void *old_kdata,
+		struct bpf_link *link) {
+	struct i2c_slave_bpf_ops *ops = kdata;
+	struct i2c_slave_bpf_ops *old_ops = old_kdata;
+	struct bpf_model *model;
+	int ret = -ENOENT;
+
+	if (strcmp(ops->name, old_ops->name) != 0) {
+		return -EINVAL;
+	}
+	mutex_lock(&bpf_lock);
+	list_for_each_entry(model, &bpf_models, node) {
+		if (model->ops == old_ops) {
+			model->ops = ops;
+			assignModel(ops->name, ops);
+			ret = 0;
+			break;
+		}
+	}
+	mutex_unlock(&bpf_lock);
+
+	synchronize_rcu();
+	return ret;
+}
+
+static bool i2c_slave_bpf_is_valid_access(int off, int size,
+		enum bpf_access_type type, const struct bpf_prog *prog,
+		struct bpf_insn_access_aux *info) {
+	return bpf_tracing_btf_ctx_access(off, size, type, prog, info);
+}
+
+static const struct bpf_verifier_ops i2c_slave_bpf_verifier_ops = {
+	.get_func_proto = bpf_base_func_proto,
+	.is_valid_access = i2c_slave_bpf_is_valid_access,
+};
+
+static int i2c_slave_bpf_event_stub(u32 id, u32 event, u32 val) {
+	return 0;
+}
+
+static struct i2c_slave_bpf_ops __bpf_i2c_slave_bpf_ops = {
+	.event = i2c_slave_bpf_event_stub,
+};
+
+static struct bpf_struct_ops bpf_i2c_slave_bpf_ops = {
+	.verifier_ops = &i2c_slave_bpf_verifier_ops,
+	.init = i2c_slave_bpf_ops_init,
+	.init_member = i2c_slave_bpf_init_member,
+	.validate = i2c_slave_bpf_validate,
+	.reg = i2c_slave_bpf_reg,
+	.unreg = i2c_slave_bpf_unreg,
+	.update = i2c_slave_bpf_update,
+	.cfi_stubs = &__bpf_i2c_slave_bpf_ops,
+	.name = "i2c_slave_bpf_ops",
+	.owner = THIS_MODULE,
+};
+
+/**
+ * Sysfs function that shows the name of the selected model.
+ */
+ssize_t model_show(struct device *dev, struct device_attribute *attr,
+			char *buf);
+ssize_t model_show(struct device *dev, struct device_attribute *attr,
+			char *buf) {
+	struct bpf_slave_data *slave
+		= (struct bpf_slave_data*)i2c_get_clientdata(to_i2c_client(dev));
+	ssize_t res;
+
+	mutex_lock(&bpf_lock);
+	res = scnprintf(buf, PAGE_SIZE, "%s\n", slave->model);
+	mutex_unlock(&bpf_lock);
+	return res;
+}
+
+/**
+ * Sysfs function that selects the model.
+ */
+ssize_t model_store(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count);
+ssize_t model_store(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count) {
+	struct bpf_slave_data *slave
+		= (struct bpf_slave_data*)i2c_get_clientdata(to_i2c_client(dev));
+	char name[I2C_SLAVE_BPF_NAME_LEN];
+	size_t len = strcspn(buf, "\n");
+
+	if (len >= sizeof(name)) {
+		return -EINVAL;
+	}
+	memcpy(name, buf, len);
+	name[len] = 0;
+
+	dev_dbg(dev, "Select model %s\n", name);
+	mutex_lock(&bpf_lock);
+	strscpy(slave->model, name, sizeof(slave->model));
+	rcu_assign_pointer(slave->ops, findModel(name));
+	mutex_unlock(&bpf_lock);
+
+	synchronize_rcu();
+	return count;
+}
+
+/**
+ * Registers a new slave device.
+ */
+static int i2c_slave_bpf_probe(struct i2c_client *client) {
+	struct bpf_slave_data *slave;
+	int ret;
+
+	// Allocate private (device) data
+	slave = devm_kzalloc(&client->dev, sizeof(struct bpf_slave_data),
+			GFP_KERNEL);
+	if (!slave) {
+		return -ENOMEM;
+	}
+	slave->id = (u32)i2c_adapter_id(client->adapter) << 16 | client->addr;
+	i2c_set_clientdata(client, slave);
+
+	// Prepare sysfs
+	sysfs_attr_init(slave->model_ac.attr);
+	slave->model_ac.attr.name = "model";
+	slave->model_ac.attr.mode = S_IRUGO | S_IWUSR;
+	slave->model_ac.show = model_show;
+	slave->model_ac.store = model_store;
+	ret = sysfs_create_file(&client->dev.kobj, &slave->model_ac.attr);
+	if (ret)
+		return ret;
+
+	mutex_lock(&bpf_lock);
+	list_add_tail(&slave->node, &bpf_slaves);
+	mutex_unlock(&bpf_lock);
+
+	// Register as slave
+	ret = i2c_slave_register(client, i2c_slave_bpf_slave_cb);
+	if (ret) {
+		mutex_lock(&bpf_lock);
+		list_del(&slave->node);
+		mutex_unlock(&bpf_lock);
+		sysfs_remove_file(&client->dev.kobj, &slave->model_ac.attr);
+		return ret;
+	}
+
+	return 0;
+};
+
+static void i2c_slave_bpf_remove(struct i2c_client *client) {
+	struct bpf_slave_data *slave = i2c_get_clientdata(client);
+
+	i2c_slave_unregister(client);
+	mutex_lock(&bpf_lock);
+	list_del(&slave->node);
+	mutex_unlock(&bpf_lock);
+	sysfs_remove_file(&client->dev.kobj, &slave->model_ac.attr);
+}
+
+static const struct i2c_device_id i2c_slave_bpf_id[] = {
+	{ "slave-bpf", 0 },
+	{ }
+};
+MODULE_DEVICE_TABLE(i2c, i2c_slave_bpf_id);
+
+static struct i2c_driver i2c_slave_bpf_driver = {
+	.driver = {
+		.name = "i2c-slave-bpf",
+	},
+	.probe = i2c_slave_bpf_probe,
+	.remove = i2c_slave_bpf_remove,
+	.id_table = i2c_slave_bpf_id,
+};
+
+static int __init i2c_slave_bpf_init(void) {
+	int ret;
+
+	ret = i2c_add_driver(&i2c_slave_bpf_driver);
+	if (ret) {
+		return ret;
+	}
+	// There is no function for unregistering the struct_ops type,
+	// so it is registered last and nothing can fail afterwards
+	ret = register_bpf_struct_ops(&bpf_i2c_slave_bpf_ops, i2c_slave_bpf_ops);
+	if (ret) {
+		i2c_del_driver(&i2c_slave_bpf_driver);
+	}
+	return ret;
+}
+
+static void __exit i2c_slave_bpf_exit(void) {
+	i2c_del_driver(&i2c_slave_bpf_driver);
+}
+
+module_init(i2c_slave_bpf_init); // @suppress("Unused function declaration")
+module_exit(i2c_slave_bpf_exit); // @suppress("Unused function declaration")
+
+MODULE_AUTHOR("Michael N. Lipp <mnl@mnl.de>");
+MODULE_DESCRIPTION("I2C slave mode device with BPF device model");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Sample device model for i2c-slave-bpf: a register file with 256
+ * registers and an auto-incremented register pointer, written
+ * with the first byte of a write transfer (like a 24C02 EEPROM).
+ *
+ * Copyright (C) 2020 by Michael N. Lipp
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+char _license[] SEC("license") = "GPL";
+
+struct regfile {
+	__u8 regs[256];
+	__u8 ptr;
+	__u8 ptr_set;
+};
+
+/*
+ * The state of all devices using this model, keyed by the device's
+ * id (adapter number << 16 | address).
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 128);
+	__type(key, __u32);
+	__type(value, struct regfile);
+} regfiles SEC(".maps");
+
+static const struct regfile initial;
+
+SEC("struct_ops/regfile_event")
+int BPF_PROG(regfile_event, __u32 id, __u32 event, __u32 val)
+{
+	struct regfile *rf;
+
+	rf = bpf_map_lookup_elem(&regfiles, &id);
+	if (!rf) {
+		bpf_map_update_elem(&regfiles, &id, &initial, BPF_NOEXIST);
+		rf = bpf_map_lookup_elem(&regfiles, &id);
+		if (!rf)
+			return -1;
+	}
+
+	switch (event) {
+	case I2C_SLAVE_WRITE_REQUESTED:
+		rf->ptr_set = 0;
+		return 0;
+
+	case I2C_SLAVE_WRITE_RECEIVED:
+		if (!rf->ptr_set) {
+			rf->ptr = val;
+			rf->ptr_set = 1;
+			return 0;
+		}
+		rf->regs[rf->ptr++] = val;
+		return 0;
+
+	case I2C_SLAVE_READ_REQUESTED:
+	case I2C_SLAVE_READ_PROCESSED:
+		return rf->regs[rf->ptr++];
+	}
+	return 0;
+}
+
+SEC(".struct_ops.link")
+struct i2c_slave_bpf_ops regfile = {
+	.event = (void *)regfile_event,
+	.name = "regfile",
+};
@@ -14,6 +14,7 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/sysfs.h>
+#include <linux/xarray.h>
 
 #define AC_THF (1 << 6)
 #define AC_TLF (1 << 5)
@@ -21,6 +22,7 @@
 #define AC_1SHOT (1 << 0)
 
 struct ds1621_data {
+	struct i2c_client *client;
 	/** Temperature stored using sysfs */
 	int stored_temperature;
 	/**
@@ -46,9 +48,39 @@ struct ds1621_data {
 	struct device_attribute temperature_ac;
 	/** Sysfs attribute for showing Tout state */
 	struct device_attribute tout_ac;
+	/** Sysfs attributes for showing the THF and TLF flags */
+	struct device_attribute thf_ac;
+	struct device_attribute tlf_ac;
+	/**
+	 * The sysfs nodes of tout, thf and tlf. Notifying a node is
+	 * possible in any context, unlike notifying by name.
+	 */
+	struct kernfs_node *tout_kn;
+	struct kernfs_node *thf_kn;
+	struct kernfs_node *tlf_kn;
 	spinlock_t register_lock;
 };
 
+/**
+ * Record written to the driver's "temperatures" attribute.
+ */
+struct ds1621_temperature_record {
+	u16 adapter;
+	u16 addr;
+	s32 temperature;
+};
+
+/**
+ * All devices, indexed by adapter number (upper 16 bits) and
+ * address (lower 16 bits).
+ */
+static DEFINE_XARRAY(ds1621_devices);
+
+static unsigned long deviceKey(struct i2c_client *client) {
+	return (unsigned long)i2c_adapter_id(client->adapter) << 16
+			| client->addr;
+}
+
 /**
  * Convert internal value representation (MSB integer part,
  * LSB 0,5) to m°C.
@@ -62,11 +94,64 @@ static int leftAlignedToInt(s16 value) {
 }
 
 /**
- * Update the measured temperature. Apart from setting the value,
- * this function adjusts the flags in AC and tOutActive.
+ * Returns the logical value of the Tout pin.
  */
-static void updateTemperature(struct ds1621_data *ds1621, int value) {
+static u8 toutLevel(struct ds1621_data *ds1621) {
+	return (ds1621->AC & AC_POL) ? ds1621->tOutActive
+			: (1 - ds1621->tOutActive);
+}
+
+/**
+ * Returns the state of the signals that can be waited for using
+ * poll on the sysfs attributes: the THF and TLF flags (at their
+ * positions in AC) and Tout (as bit 0).
+ */
+static u8 signalState(struct ds1621_data *ds1621) {
+	return (ds1621->AC & (AC_THF | AC_TLF)) | toutLevel(ds1621);
+}
+
+/** The signals, as in the value returned by signalState(). */
+static const u8 signals[] = { 1, AC_THF, AC_TLF };
+
+/**
+ * Returns the sysfs node to notify when the signal changes.
+ */
+static struct kernfs_node *signalNode(struct ds1621_data *ds1621, u8 signal) {
+	switch (signal) {
+	case AC_THF:
+		return ds1621->thf_kn;
+	case AC_TLF:
+		return ds1621->tlf_kn;
+	default:
+		return ds1621->tout_kn;
+	}
+}
+
+/**
+ * Notifies the pollers of the sysfs attributes of the given
+ * (changed) signals.
+ */
+static void notifySignals(struct ds1621_data *ds1621, u8 changed) {
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(signals); i++) {
+		if (changed & signals[i]) {
+			sysfs_notify_dirent(signalNode(ds1621, signals[i]));
+		}
+	}
+}
+
+/**
+ * Set the measured temperature. Apart from setting the value,
+ * this function adjusts the flags in AC and tOutActive. Returns
+ * the signals that have changed, for the caller to notify.
+ */
+static u8 setMeasuredTemperature(struct ds1621_data *ds1621, int value) {
+	u8 before;
+	u8 changed;
+
 	spin_lock(&ds1621->register_lock);
+	before = signalState(ds1621);
 	ds1621->measured_temperature = value;
 	if (value >= leftAlignedToInt(ds1621->TH)) {
 		ds1621->AC |= AC_THF;
@@ -78,7 +163,30 @@ static void updateTemperature(struct ds1621_data *ds1621, int value) {
 	if (value < leftAlignedToInt(ds1621->TL)) {
 		ds1621->tOutActive = 0;
 	}
+	changed = before ^ signalState(ds1621);
 	spin_unlock(&ds1621->register_lock);
+	return changed;
+}
+
+/**
+ * Update the measured temperature and notify the pollers of the
+ * signals that have changed.
+ */
+static void updateTemperature(struct ds1621_data *ds1621, int value) {
+	notifySignals(ds1621, setMeasuredTemperature(ds1621, value));
+}
+
+/**
+ * Set the "sensor" temperature. The measured temperature is updated
+ * as well if converting continuously. Returns the signals that have
+ * changed, for the caller to notify.
+ */
+static u8 setStoredTemperature(struct ds1621_data *ds1621, int value) {
+	ds1621->stored_temperature = value;
+	if (!ds1621->converting_continuously) {
+		return 0;
+	}
+	return setMeasuredTemperature(ds1621, value);
 }
 
 static void handle_command(struct ds1621_data *ds1621, u8 cmd) {
@@ -138,6 +246,7 @@ static void handle_command(struct ds1621_data *ds1621, u8 cmd) {
 static int i2c_slave_ds1621_slave_cb(struct i2c_client *client,
 				     enum i2c_slave_event event, u8 *val) {
 	struct ds1621_data *ds1621 = i2c_get_clientdata(client);
+	u8 before;
 
 	switch (event) {
 	case I2C_SLAVE_WRITE_RECEIVED:
@@ -156,7 +265,10 @@ static int i2c_slave_ds1621_slave_cb(struct i2c_client *client,
 						updateTemperature(ds1621, ds1621->measured_temperature);
 					}
 				} else {
+					// Writing AC may change POL or clear flags
+					before = signalState(ds1621);
 					*((u8*)(ds1621->write_target)) = ds1621->buffer;
+					notifySignals(ds1621, before ^ signalState(ds1621));
 				}
 			}
 		}
@@ -206,17 +318,16 @@ ssize_t temperature_store(struct device *dev, struct device_attribute *attr,
 ssize_t temperature_store(struct device *dev, struct device_attribute *attr,
 			 const char *buf, size_t count) {
 	int res;
+	int value;
 	struct ds1621_data *ds1621
 		= (struct ds1621_data*)i2c_get_clientdata(to_i2c_client(dev));
 
 	dev_dbg(dev, "Store temperature %s\n", buf);
-	res = kstrtoint(buf, 10, &ds1621->stored_temperature);
+	res = kstrtoint(buf, 10, &value);
 	if (res < 0) {
 		return res;
 	}
-	if (ds1621->converting_continuously) {
-		updateTemperature(ds1621, ds1621->stored_temperature);
-	}
+	notifySignals(ds1621, setStoredTemperature(ds1621, value));
 	return count;
 }
 
@@ -229,9 +340,91 @@ ssize_t tout_show(struct device *dev, struct device_attribute *attr,
 			char *buf) {
 	struct ds1621_data *ds1621
 		= (struct ds1621_data*)i2c_get_clientdata(to_i2c_client(dev));
-    return scnprintf(buf, PAGE_SIZE, "%d\n",
-    		(ds1621->AC & AC_POL) ? ds1621->tOutActive : (1 - ds1621->tOutActive));
+    return scnprintf(buf, PAGE_SIZE, "%d\n", toutLevel(ds1621));
+}
+
+/**
+ * Sysfs function that shows the THF flag.
+ */
+ssize_t thf_show(struct device *dev, struct device_attribute *attr,
+			char *buf);
+ssize_t thf_show(struct device *dev, struct device_attribute *attr,
+			char *buf) {
+	struct ds1621_data *ds1621
+		= (struct ds1621_data*)i2c_get_clientdata(to_i2c_client(dev));
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(ds1621->AC & AC_THF));
+}
+
+/**
+ * Sysfs function that shows the TLF flag.
+ */
+ssize_t tlf_show(struct device *dev, struct device_attribute *attr,
+			char *buf);
+ssize_t tlf_show(struct device *dev, struct device_attribute *attr,
+			char *buf) {
+	struct ds1621_data *ds1621
+		= (struct ds1621_data*)i2c_get_clientdata(to_i2c_client(dev));
+    return scnprintf(buf, PAGE_SIZE, "%d\n", !!(ds1621->AC & AC_TLF));
+}
+
+/**
+ * Sysfs function of the driver that stores the sensor temperatures
+ * of several devices. The data written is an array of
+ * struct ds1621_temperature_record. Records for unknown devices
+ * are ignored. The nodes of the signals that have changed are
+ * collected (with references taken) while the devices are locked
+ * and notified afterwards.
+ */
+static ssize_t temperatures_store(struct device_driver *driver,
+			const char *buf, size_t count) {
+	struct ds1621_temperature_record record;
+	struct ds1621_data *ds1621;
+	struct kernfs_node **notify;
+	size_t offset;
+	int pending = 0;
+	u8 changed;
+	int i;
+
+	if (count % sizeof(record)) {
+		return -EINVAL;
+	}
+	notify = kmalloc_array(count / sizeof(record) * ARRAY_SIZE(signals),
+			sizeof(*notify), GFP_KERNEL);
+	if (!notify) {
+		return -ENOMEM;
+	}
+	// Prevent devices from being removed while updating
+	xa_lock(&ds1621_devices);
+	for (offset = 0; offset < count; offset += sizeof(record)) {
+		memcpy(&record, buf + offset, sizeof(record));
+		ds1621 = xa_load(&ds1621_devices,
+				(unsigned long)record.adapter << 16 | record.addr);
+		if (!ds1621) {
+			continue;
+		}
+		changed = setStoredTemperature(ds1621, record.temperature);
+		for (i = 0; i < ARRAY_SIZE(signals); i++) {
+			if (changed & signals[i]) {
+				notify[pending++]
+						= sysfs_get(signalNode(ds1621, signals[i]));
+			}
+		}
+	}
+	xa_unlock(&ds1621_devices);
+	for (i = 0; i < pending; i++) {
+		sysfs_notify_dirent(notify[i]);
+		sysfs_put(notify[i]);
+	}
+	kfree(notify);
+	return count;
 }
+static DRIVER_ATTR_WO(temperatures);
+
+static struct attribute *i2c_slave_ds1621_driver_attrs[] = {
+	&driver_attr_temperatures.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(i2c_slave_ds1621_driver);
 
 /**
  * Registers a new slave device if the given address is valid.
@@ -252,6 +445,7 @@ static int i2c_slave_ds1621_probe(struct i2c_client *client) {
 	}
 
 	// Initialize private data
+	ds1621->client = client;
 	ds1621->stored_temperature = 21000;
 	ds1621->measured_temperature = 0;
 	ds1621->TL = 0;
@@ -279,24 +473,71 @@ static int i2c_slave_ds1621_probe(struct i2c_client *client) {
 	ds1621->tout_ac.store = NULL;
 	ret = sysfs_create_file(&client->dev.kobj, &ds1621->tout_ac.attr);
 	if (ret)
-		return ret;
+		goto fail_temperature;
+	sysfs_attr_init(ds1621->thf_ac.attr);
+	ds1621->thf_ac.attr.name = "thf";
+	ds1621->thf_ac.attr.mode = S_IRUGO;
+	ds1621->thf_ac.show = thf_show;
+	ds1621->thf_ac.store = NULL;
+	ret = sysfs_create_file(&client->dev.kobj, &ds1621->thf_ac.attr);
+	if (ret)
+		goto fail_tout;
+	sysfs_attr_init(ds1621->tlf_ac.attr);
+	ds1621->tlf_ac.attr.name = "tlf";
+	ds1621->tlf_ac.attr.mode = S_IRUGO;
+	ds1621->tlf_ac.show = tlf_show;
+	ds1621->tlf_ac.store = NULL;
+	ret = sysfs_create_file(&client->dev.kobj, &ds1621->tlf_ac.attr);
+	if (ret)
+		goto fail_thf;
+	ds1621->tout_kn = sysfs_get_dirent(client->dev.kobj.sd, "tout");
+	ds1621->thf_kn = sysfs_get_dirent(client->dev.kobj.sd, "thf");
+	ds1621->tlf_kn = sysfs_get_dirent(client->dev.kobj.sd, "tlf");
+	if (!ds1621->tout_kn || !ds1621->thf_kn || !ds1621->tlf_kn) {
+		ret = -ENOENT;
+		goto fail_dirents;
+	}
+
+	// Make available for bulk updates
+	ret = xa_insert(&ds1621_devices, deviceKey(client), ds1621, GFP_KERNEL);
+	if (ret)
+		goto fail_dirents;
 
 	// Register as slave
 	ret = i2c_slave_register(client, i2c_slave_ds1621_slave_cb);
-	if (ret) {
-		sysfs_remove_file(&client->dev.kobj, &ds1621->temperature_ac.attr);
-		return ret;
-	}
+	if (ret)
+		goto fail_xa;
 
 	return 0;
+
+ fail_xa:
+	xa_erase(&ds1621_devices, deviceKey(client));
+ fail_dirents:
+	sysfs_put(ds1621->tlf_kn);
+	sysfs_put(ds1621->thf_kn);
+	sysfs_put(ds1621->tout_kn);
+	sysfs_remove_file(&client->dev.kobj, &ds1621->tlf_ac.attr);
+ fail_thf:
+	sysfs_remove_file(&client->dev.kobj, &ds1621->thf_ac.attr);
+ fail_tout:
+	sysfs_remove_file(&client->dev.kobj, &ds1621->tout_ac.attr);
+ fail_temperature:
+	sysfs_remove_file(&client->dev.kobj, &ds1621->temperature_ac.attr);
+	return ret;
 };
 
 static void i2c_slave_ds1621_remove(struct i2c_client *client) {
 	struct ds1621_data *ds1621 = i2c_get_clientdata(client);
 
 	i2c_slave_unregister(client);
+	xa_erase(&ds1621_devices, deviceKey(client));
+	sysfs_put(ds1621->tlf_kn);
+	sysfs_put(ds1621->thf_kn);
+	sysfs_put(ds1621->tout_kn);
 	sysfs_remove_file(&client->dev.kobj, &ds1621->temperature_ac.attr);
 	sysfs_remove_file(&client->dev.kobj, &ds1621->tout_ac.attr);
+	sysfs_remove_file(&client->dev.kobj, &ds1621->thf_ac.attr);
+	sysfs_remove_file(&client->dev.kobj, &ds1621->tlf_ac.attr);
 }
 
 static const struct i2c_device_id i2c_slave_ds1621_id[] = {
@@ -308,6 +549,7 @@ MODULE_DEVICE_TABLE(i2c, i2c_slave_ds1621_id);
 static struct i2c_driver i2c_slave_ds1621_driver = {
 	.driver = {
 		.name = "i2c-slave-ds1621",
+		.groups = i2c_slave_ds1621_driver_groups,
 	},
 	.probe = i2c_slave_ds1621_probe,
 	.remove = i2c_slave_ds1621_remove,
@@ -0,0 +1,378 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * I2C slave mode FIFO based IMU (accelerometer/gyroscope) simulator
+ *
+ * Copyright (C) 2020 by Michael N. Lipp
+ */
+
+#define DEBUG 1
+#define pr_fmt(fmt) "i2c-sim-imu: " fmt
+
+#include <linux/i2c.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+// Registers
+#define REG_FIFO_CTRL1 0x07
+#define REG_FIFO_CTRL2 0x08
+#define REG_FIFO_CTRL4 0x0a
+#define REG_WHO_AM_I 0x0f
+#define REG_CTRL1 0x10
+#define REG_CTRL3 0x12
+#define REG_FIFO_STATUS1 0x3a
+#define REG_FIFO_STATUS2 0x3b
+#define REG_FIFO_DATA_OUT 0x3e
+
+#define WHO_AM_I 0x6c
+
+#define CTRL3_SW_RESET (1 << 0)
+#define CTRL3_IF_INC (1 << 2)
+
+#define FIFO_MODE_BYPASS 0
+#define FIFO_MODE_FIFO 1
+#define FIFO_MODE_CONTINUOUS 6
+
+#define STATUS2_WTM (1 << 7)
+#define STATUS2_OVR (1 << 6)
+#define STATUS2_FULL (1 << 5)
+#define STATUS2_EMPTY (1 << 4)
+
+/** FIFO capacity in samples */
+#define IMU_FIFO_SIZE 512
+/** Gyroscope x, y, z and accelerometer x, y, z, 16 bit each */
+#define IMU_SAMPLE_SIZE 12
+
+/**
+ * Sample periods (ns) for the ODR codes in CTRL1[7:4]
+ * (off, 12.5 Hz ... 6664 Hz).
+ */
+static const u32 odr_periods[] = {
+	0, 80000000, 38461538, 19230769, 9615385, 4807692,
+	2403846, 1200480, 600240, 300120, 150060,
+};
+
+/**
+ * The FIFO doesn't store samples. A sample's values are derived
+ * from its sequence number, so the FIFO is completely described
+ * by the sequence numbers of the oldest unread and the next
+ * sample. Samples are generated when the device is accessed,
+ * based on the time that has passed since the last access.
+ */
+struct imu_data {
+	u8 ctrl1;
+	u8 ctrl3;
+	u8 fifo_mode;
+	u16 watermark;
+	/** Duration of a sample period, 0 if sampling is off */
+	u32 period;
+	/** Time (ktime ns) at which the next sample is due */
+	u64 next_sample;
+	/** Sequence number of the next sample to be generated */
+	u64 gen;
+	/** Sequence number of the oldest sample in the FIFO */
+	u64 head;
+	/** Set if samples were lost, cleared when reading FIFO_STATUS2 */
+	u8 overrun;
+	/** Set in FIFO mode when the FIFO has become full */
+	u8 stopped;
+	/** The sample being read from FIFO_DATA_OUT */
+	u8 sample[IMU_SAMPLE_SIZE];
+	/** Bytes of sample that haven't been read yet */
+	u8 sample_left;
+	/** The register pointer */
+	u8 reg;
+	/** Set after the register pointer has been received */
+	u8 addressed;
+};
+
+/**
+ * Generates the samples that have become due since the last
+ * invocation.
+ */
+static void generateSamples(struct imu_data *imu) {
+	u64 now, due, space;
+
+	if (imu->period == 0) {
+		return;
+	}
+	now = ktime_get_ns();
+	if (now < imu->next_sample) {
+		return;
+	}
+	due = div64_u64(now - imu->next_sample, imu->period) + 1;
+	imu->next_sample += due * imu->period;
+
+	switch (imu->fifo_mode) {
+	case FIFO_MODE_FIFO:
+		// Stops collecting when full
+		if (imu->stopped) {
+			break;
+		}
+		space = IMU_FIFO_SIZE - (imu->gen - imu->head);
+		if (due >= space) {
+			imu->stopped = 1;
+			if (due > space) {
+				imu->overrun = 1;
+			}
+			due = space;
+		}
+		imu->gen += due;
+		break;
+	case FIFO_MODE_CONTINUOUS:
+		// Overwrites the oldest samples when full
+		imu->gen += due;
+		if (imu->gen - imu->head > IMU_FIFO_SIZE) {
+			imu->head = imu->gen - IMU_FIFO_SIZE;
+			imu->overrun = 1;
+		}
+		break;
+	default:
+		// Bypass, the FIFO isn't used
+		break;
+	}
+}
+
+/**
+ * Empties the FIFO and resets the flags. The data rate's timing
+ * is preserved.
+ */
+static void resetFifo(struct imu_data *imu) {
+	imu->head = imu->gen;
+	imu->sample_left = 0;
+	imu->overrun = 0;
+	imu->stopped = 0;
+}
+
+static void setOdr(struct imu_data *imu, u8 ctrl1) {
+	u8 odr = ctrl1 >> 4;
+
+	generateSamples(imu);
+	imu->ctrl1 = ctrl1;
+	imu->period = odr < ARRAY_SIZE(odr_periods) ? odr_periods[odr] : 0;
+	imu->next_sample = ktime_get_ns() + imu->period;
+}
+
+static void putWord(u8 *buf, s16 value) {
+	buf[0] = value & 0xff;
+	buf[1] = (u16)value >> 8;
+}
+
+/**
+ * Removes the oldest sample from the FIFO and makes it the sample
+ * being read. The gyroscope's x value is the (truncated) sequence
+ * number, which allows the reader to detect lost samples. The
+ * accelerometer shows a triangle wave on x (and inverted on y)
+ * and 1 g on z (full scale ±2 g).
+ */
+static void popSample(struct imu_data *imu) {
+	u32 seq = imu->head++;
+	u32 phase = seq & 0x3ff;
+	s16 triangle = (phase < 0x200 ? phase : 0x3ff - phase) * 64 - 0x4000;
+
+	putWord(&imu->sample[0], seq);
+	putWord(&imu->sample[2], ~seq);
+	putWord(&imu->sample[4], 0);
+	putWord(&imu->sample[6], triangle);
+	putWord(&imu->sample[8], -triangle);
+	putWord(&imu->sample[10], 0x4000);
+	imu->sample_left = IMU_SAMPLE_SIZE;
+}
+
+/**
+ * Returns the next byte from FIFO_DATA_OUT. If the FIFO is empty,
+ * it is checked for new samples and 0 is returned if there still
+ * are none.
+ */
+static u8 readFifo(struct imu_data *imu) {
+	if (imu->sample_left == 0) {
+		if (imu->head == imu->gen) {
+			generateSamples(imu);
+			if (imu->head == imu->gen) {
+				return 0;
+			}
+		}
+		popSample(imu);
+	}
+	return imu->sample[IMU_SAMPLE_SIZE - imu->sample_left--];
+}
+
+static u8 readRegister(struct imu_data *imu, u8 reg) {
+	u64 diff = imu->gen - imu->head;
+	u8 value;
+
+	switch (reg) {
+	case REG_FIFO_CTRL1:
+		return imu->watermark & 0xff;
+	case REG_FIFO_CTRL2:
+		return imu->watermark >> 8;
+	case REG_FIFO_CTRL4:
+		return imu->fifo_mode;
+	case REG_WHO_AM_I:
+		return WHO_AM_I;
+	case REG_CTRL1:
+		return imu->ctrl1;
+	case REG_CTRL3:
+		return imu->ctrl3;
+	case REG_FIFO_STATUS1:
+		return diff & 0xff;
+	case REG_FIFO_STATUS2:
+		value = (diff >> 8) & 0x03;
+		if (imu->watermark && diff >= imu->watermark) {
+			value |= STATUS2_WTM;
+		}
+		if (imu->overrun) {
+			value |= STATUS2_OVR;
+			imu->overrun = 0;
+		}
+		if (diff == IMU_FIFO_SIZE) {
+			value |= STATUS2_FULL;
+		}
+		if (diff == 0) {
+			value |= STATUS2_EMPTY;
+		}
+		return value;
+	case REG_FIFO_DATA_OUT:
+		return readFifo(imu);
+	default:
+		return 0;
+	}
+}
+
+static void reset(struct imu_data *imu) {
+	imu->ctrl1 = 0;
+	imu->ctrl3 = CTRL3_IF_INC;
+	imu->fifo_mode = FIFO_MODE_BYPASS;
+	imu->watermark = 0;
+	imu->period = 0;
+	resetFifo(imu);
+}
+
+static void writeRegister(struct imu_data *imu, u8 reg, u8 value) {
+	switch (reg) {
+	case REG_FIFO_CTRL1:
+		imu->watermark = (imu->watermark & 0x100) | value;
+		break;
+	case REG_FIFO_CTRL2:
+		imu->watermark = (imu->watermark & 0xff) | ((value & 1) << 8);
+		break;
+	case REG_FIFO_CTRL4:
+		// Any mode change restarts the FIFO
+		generateSamples(imu);
+		imu->fifo_mode = value & 0x07;
+		resetFifo(imu);
+		break;
+	case REG_CTRL1:
+		setOdr(imu, value);
+		break;
+	case REG_CTRL3:
+		if (value & CTRL3_SW_RESET) {
+			reset(imu);
+		} else {
+			imu->ctrl3 = value;
+		}
+		break;
+	default:
+		// Read only or reserved
+		break;
+	}
+}
+
+/**
+ * Advances the register pointer after an access. Reading the
+ * FIFO doesn't advance it, so a burst read from FIFO_DATA_OUT
+ * drains the FIFO.
+ */
+static void nextRegister(struct imu_data *imu) {
+	if (imu->reg != REG_FIFO_DATA_OUT && (imu->ctrl3 & CTRL3_IF_INC)) {
+		imu->reg++;
+	}
+}
+
+/**
+ * Slave callback routine. Handles the data received from or to be
+ * sent to the I2C master. The first byte written is the register
+ * address, further bytes are written to the registers. Bytes are
+ * consumed when sent, so reading from the FIFO is exact even if
+ * a sample is read with several transfers.
+ */
+static int i2c_slave_imu_slave_cb(struct i2c_client *client,
+				     enum i2c_slave_event event, u8 *val) {
+	struct imu_data *imu = i2c_get_clientdata(client);
+
+	switch (event) {
+	case I2C_SLAVE_WRITE_RECEIVED:
+		if (!imu->addressed) {
+			imu->reg = *val;
+			imu->addressed = 1;
+		} else {
+			dev_dbg(&client->dev, "Write %02x to %02x\n", *val, imu->reg);
+			writeRegister(imu, imu->reg, *val);
+			nextRegister(imu);
+		}
+		break;
+
+	case I2C_SLAVE_READ_REQUESTED:
+		// Status and data are up to date at the start of a read
+		generateSamples(imu);
+		/* fall through */
+		/* no break */
+	case I2C_SLAVE_READ_PROCESSED:
+		*val = readRegister(imu, imu->reg);
+		nextRegister(imu);
+		break;
+
+	case I2C_SLAVE_WRITE_REQUESTED:
+		imu->addressed = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * Registers a new slave device.
+ */
+static int i2c_slave_imu_probe(struct i2c_client *client) {
+	struct imu_data *imu;
+
+	// Allocate private (device) data
+	imu = devm_kzalloc(&client->dev, sizeof(struct imu_data), GFP_KERNEL);
+	if (!imu) {
+		return -ENOMEM;
+	}
+	reset(imu);
+	i2c_set_clientdata(client, imu);
+
+	// Register as slave
+	return i2c_slave_register(client, i2c_slave_imu_slave_cb);
+};
+
+static void i2c_slave_imu_remove(struct i2c_client *client) {
+	i2c_slave_unregister(client);
+}
+
+static const struct i2c_device_id i2c_slave_imu_id[] = {
+	{ "slave-imu", 0 },
+	{ }
+};
+MODULE_DEVICE_TABLE(i2c, i2c_slave_imu_id);
+
+static struct i2c_driver i2c_slave_imu_driver = {
+	.driver = {
+		.name = "i2c-slave-imu",
+	},
+	.probe = i2c_slave_imu_probe,
+	.remove = i2c_slave_imu_remove,
+	.id_table = i2c_slave_imu_id,
+};
+module_i2c_driver(i2c_slave_imu_driver); // @suppress("Unused function declaration")
+
+MODULE_AUTHOR("Michael N. Lipp <mnl@mnl.de>");
+MODULE_DESCRIPTION("I2C slave mode FIFO based IMU simulator");
+MODULE_LICENSE("GPL v2");
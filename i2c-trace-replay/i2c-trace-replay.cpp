@@ -0,0 +1,435 @@
+/*
+ * i2c-trace-replay.cpp
+ *
+ * Replays I2C transfers recorded with the kernel's i2c trace events
+ * (i2c_write, i2c_read, i2c_reply, i2c_result) against the simulated
+ * devices and reports the responses that differ from the recorded
+ * ones.
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "i2c-virt-batch.h"
+
+struct Message {
+	uint16_t addr;
+	uint16_t flags;
+	/** The length when issuing the message. */
+	uint16_t len;
+	/** The data sent (write) or the recorded reply (read). */
+	std::vector<uint8_t> data;
+	bool hasReply = false;
+};
+
+struct Transfer {
+	/** The line of the trace with the first message. */
+	int line;
+	std::vector<Message> msgs;
+	bool hasResult = false;
+	int result = 0;
+};
+
+struct Options {
+	std::string traceFile;
+	std::string batchFile = I2C_VIRT_BATCH_PATH;
+	int device = -1;
+	int adapter = -1;
+	size_t batchSize = 256;
+	bool verbose = false;
+};
+
+static void usage() {
+	std::cerr << "Usage: i2c-trace-replay [-a adapter] [-b batch size]"
+			" [-d bus | -f batch file] [-v] trace-file" << std::endl;
+	exit(2);
+}
+
+/**
+ * Parses hex data formatted as "[12-34-56]".
+ */
+static std::vector<uint8_t> parseData(const char *str) {
+	std::vector<uint8_t> data;
+	const char *start = strchr(str, '[');
+	if (!start) {
+		return data;
+	}
+	char *pos = (char*)start + 1;
+	while (*pos && *pos != ']') {
+		data.push_back(strtoul(pos, &pos, 16));
+		if (*pos == '-') {
+			pos++;
+		}
+	}
+	return data;
+}
+
+/**
+ * Reads the trace and groups the messages into transfers.
+ */
+static std::vector<Transfer> readTrace(const Options &opts) {
+	std::ifstream in(opts.traceFile);
+	if (!in) {
+		std::cerr << "Cannot open " << opts.traceFile << std::endl;
+		exit(1);
+	}
+	std::vector<Transfer> transfers;
+	// Index of the incomplete transfer for each adapter
+	std::map<int, size_t> pending;
+	int adapterFilter = opts.adapter;
+	std::string line;
+	int lineNo = 0;
+	while (std::getline(in, line)) {
+		lineNo++;
+		const char *event;
+		bool isRead = false;
+		bool isReply = false;
+		bool isResult = false;
+		if ((event = strstr(line.c_str(), " i2c_write: "))) {
+		} else if ((event = strstr(line.c_str(), " i2c_read: "))) {
+			isRead = true;
+		} else if ((event = strstr(line.c_str(), " i2c_reply: "))) {
+			isReply = true;
+		} else if ((event = strstr(line.c_str(), " i2c_result: "))) {
+			isResult = true;
+		} else {
+			continue;
+		}
+		event = strchr(event + 1, ' ') + 1;
+
+		int adapter;
+		if (isResult) {
+			unsigned int num;
+			int ret;
+			if (sscanf(event, "i2c-%d n=%u ret=%d", &adapter, &num, &ret) != 3) {
+				continue;
+			}
+			if (adapter != adapterFilter) {
+				continue;
+			}
+			auto it = pending.find(adapter);
+			if (it != pending.end()) {
+				transfers[it->second].hasResult = true;
+				transfers[it->second].result = ret;
+				pending.erase(it);
+			}
+			continue;
+		}
+
+		unsigned int idx;
+		unsigned int addr;
+		unsigned int flags;
+		unsigned int len;
+		if (sscanf(event, "i2c-%d #%u a=%x f=%x l=%u",
+				&adapter, &idx, &addr, &flags, &len) != 5) {
+			continue;
+		}
+		if (adapterFilter < 0) {
+			// Use first adapter found
+			adapterFilter = adapter;
+		}
+		if (adapter != adapterFilter) {
+			continue;
+		}
+		auto it = pending.find(adapter);
+		if (isReply) {
+			if (it == pending.end()
+					|| idx >= transfers[it->second].msgs.size()) {
+				continue;
+			}
+			Message &msg = transfers[it->second].msgs[idx];
+			msg.data = parseData(event);
+			msg.hasReply = true;
+			continue;
+		}
+		if (idx == 0) {
+			// A new transfer (previous may have been incomplete)
+			transfers.push_back(Transfer { lineNo, {} });
+			pending[adapter] = transfers.size() - 1;
+			it = pending.find(adapter);
+		}
+		if (it == pending.end()
+				|| idx != transfers[it->second].msgs.size()) {
+			// Missing events, ignore
+			continue;
+		}
+		Message msg { (uint16_t)addr,
+			(uint16_t)(flags & (I2C_M_RD | I2C_M_RECV_LEN)), (uint16_t)len,
+			{}, false };
+		if (!isRead) {
+			msg.flags &= ~(I2C_M_RD | I2C_M_RECV_LEN);
+			msg.data = parseData(event);
+			msg.data.resize(len);
+		} else {
+			msg.flags |= I2C_M_RD;
+		}
+		transfers[it->second].msgs.push_back(msg);
+	}
+	return transfers;
+}
+
+static std::string hex(const uint8_t *data, size_t len) {
+	std::ostringstream out;
+	char buf[4];
+	for (size_t i = 0; i < len; i++) {
+		snprintf(buf, sizeof(buf), i == 0 ? "%02x" : "-%02x", data[i]);
+		out << buf;
+	}
+	return out.str();
+}
+
+/**
+ * Compares the replayed transfer with the recorded one. The data
+ * of the read messages is concatenated in "data". Returns true
+ * if there is no divergence.
+ */
+static bool compare(size_t index, const Transfer &xfer,
+		int ret, const uint8_t *data, size_t len) {
+	std::ostringstream report;
+	if (xfer.hasResult && ret != xfer.result) {
+		report << "  result " << ret << ", expected " << xfer.result
+				<< std::endl;
+	}
+	size_t pos = 0;
+	for (size_t i = 0; ret >= 0 && i < xfer.msgs.size(); i++) {
+		const Message &msg = xfer.msgs[i];
+		if (!(msg.flags & I2C_M_RD)) {
+			continue;
+		}
+		size_t msgLen = msg.len;
+		if (msg.flags & I2C_M_RECV_LEN) {
+			msgLen = pos < len ? msg.len + data[pos] : 0;
+		}
+		msgLen = std::min(msgLen, len - pos);
+		if (msg.hasReply && (msgLen != msg.data.size()
+				|| memcmp(data + pos, msg.data.data(), msgLen) != 0)) {
+			char addr[8];
+			snprintf(addr, sizeof(addr), "0x%02x", msg.addr);
+			report << "  msg " << i << " a=" << addr << ": got ["
+					<< hex(data + pos, msgLen) << "], expected ["
+					<< hex(msg.data.data(), msg.data.size()) << "]"
+					<< std::endl;
+		}
+		pos += msgLen;
+	}
+	if (report.str().empty()) {
+		return true;
+	}
+	std::cout << "Transfer " << index << " (line " << xfer.line << "):"
+			<< std::endl << report.str();
+	return false;
+}
+
+/**
+ * Replays the transfers using the batch file of i2c-virt-bus.
+ */
+static size_t replayBatched(const Options &opts,
+		const std::vector<Transfer> &transfers) {
+	int fd = open(opts.batchFile.c_str(), O_RDWR);
+	if (fd < 0) {
+		perror(opts.batchFile.c_str());
+		exit(1);
+	}
+	size_t divergences = 0;
+	std::vector<uint8_t> batch;
+	std::vector<uint8_t> results(I2C_VIRT_BATCH_MAX);
+	for (size_t first = 0; first < transfers.size(); ) {
+		// Serialize as many transfers as allowed
+		batch.clear();
+		size_t last = first;
+		for (; last < transfers.size() && last - first < opts.batchSize;
+				last++) {
+			const Transfer &xfer = transfers[last];
+			size_t size = sizeof(i2c_virt_batch_xfer);
+			for (auto &msg : xfer.msgs) {
+				size += sizeof(i2c_virt_batch_msg)
+						+ ((msg.flags & I2C_M_RD) ? 0 : msg.data.size());
+			}
+			if (batch.size() + size > I2C_VIRT_BATCH_MAX && last > first) {
+				break;
+			}
+			i2c_virt_batch_xfer hdr = { (uint32_t)xfer.msgs.size() };
+			batch.insert(batch.end(), (uint8_t*)&hdr,
+					(uint8_t*)&hdr + sizeof(hdr));
+			for (auto &msg : xfer.msgs) {
+				i2c_virt_batch_msg msgHdr = { msg.addr, msg.flags, msg.len, 0 };
+				batch.insert(batch.end(), (uint8_t*)&msgHdr,
+						(uint8_t*)&msgHdr + sizeof(msgHdr));
+				if (!(msg.flags & I2C_M_RD)) {
+					batch.insert(batch.end(), msg.data.begin(), msg.data.end());
+				}
+			}
+		}
+		if (write(fd, batch.data(), batch.size()) != (ssize_t)batch.size()) {
+			perror("Writing batch");
+			exit(1);
+		}
+		size_t resultsLen = 0;
+		ssize_t res;
+		while ((res = pread(fd, results.data() + resultsLen,
+				results.size() - resultsLen, resultsLen)) > 0) {
+			resultsLen += res;
+			if (resultsLen == results.size()) {
+				results.resize(2 * results.size());
+			}
+		}
+		if (res < 0) {
+			perror("Reading results");
+			exit(1);
+		}
+
+		// Evaluate results
+		size_t pos = 0;
+		for (size_t i = first; i < last; i++) {
+			i2c_virt_batch_result result;
+			if (resultsLen - pos < sizeof(result)) {
+				std::cerr << "Incomplete results" << std::endl;
+				exit(1);
+			}
+			memcpy(&result, results.data() + pos, sizeof(result));
+			pos += sizeof(result);
+			if (!compare(i, transfers[i], result.ret,
+					results.data() + pos, result.len)) {
+				divergences++;
+			}
+			pos += result.len;
+		}
+		first = last;
+	}
+	close(fd);
+	return divergences;
+}
+
+/**
+ * Replays the transfers using I2C_RDWR, i.e. one system call
+ * per transfer.
+ */
+static size_t replayDevice(const Options &opts,
+		const std::vector<Transfer> &transfers) {
+	std::string path = "/dev/i2c-" + std::to_string(opts.device);
+	int fd = open(path.c_str(), O_RDWR);
+	if (fd < 0) {
+		perror(path.c_str());
+		exit(1);
+	}
+	size_t divergences = 0;
+	std::vector<i2c_msg> msgs;
+	std::vector<std::vector<uint8_t>> bufs;
+	std::vector<uint8_t> data;
+	for (size_t i = 0; i < transfers.size(); i++) {
+		const Transfer &xfer = transfers[i];
+		msgs.resize(xfer.msgs.size());
+		bufs.resize(xfer.msgs.size());
+		for (size_t m = 0; m < xfer.msgs.size(); m++) {
+			const Message &msg = xfer.msgs[m];
+			msgs[m].addr = msg.addr;
+			msgs[m].flags = msg.flags;
+			msgs[m].len = msg.len;
+			if (!(msg.flags & I2C_M_RD)) {
+				bufs[m] = msg.data;
+			} else if (msg.flags & I2C_M_RECV_LEN) {
+				// i2c-dev expects the initial length in the first byte
+				bufs[m].assign(msg.len + I2C_SMBUS_BLOCK_MAX, 0);
+				bufs[m][0] = msg.len;
+				msgs[m].len = bufs[m].size();
+			} else {
+				bufs[m].assign(msg.len, 0);
+			}
+			msgs[m].buf = bufs[m].data();
+		}
+		i2c_rdwr_ioctl_data ioData = { msgs.data(), (uint32_t)msgs.size() };
+		int ret = ioctl(fd, I2C_RDWR, &ioData);
+		if (ret < 0) {
+			ret = -errno;
+		}
+		data.clear();
+		for (size_t m = 0; ret >= 0 && m < msgs.size(); m++) {
+			if (!(msgs[m].flags & I2C_M_RD)) {
+				continue;
+			}
+			// i2c-dev doesn't copy the updated length back, derive
+			// it from the received count as the kernel does
+			size_t len = msgs[m].len;
+			if (msgs[m].flags & I2C_M_RECV_LEN) {
+				len = std::min(len,
+						(size_t)xfer.msgs[m].len + msgs[m].buf[0]);
+			}
+			data.insert(data.end(), msgs[m].buf, msgs[m].buf + len);
+		}
+		if (!compare(i, xfer, ret, data.data(), data.size())) {
+			divergences++;
+		}
+	}
+	close(fd);
+	return divergences;
+}
+
+int main(int argc, char **argv) {
+	Options opts;
+	int opt;
+	while ((opt = getopt(argc, argv, "a:b:d:f:v")) != -1) {
+		switch (opt) {
+		case 'a':
+			opts.adapter = atoi(optarg);
+			break;
+		case 'b':
+			opts.batchSize = std::max(1, atoi(optarg));
+			break;
+		case 'd':
+			opts.device = atoi(optarg);
+			break;
+		case 'f':
+			opts.batchFile = optarg;
+			break;
+		case 'v':
+			opts.verbose = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+	}
+	opts.traceFile = argv[optind];
+
+	std::vector<Transfer> transfers = readTrace(opts);
+	size_t msgCount = 0;
+	for (auto &xfer : transfers) {
+		msgCount += xfer.msgs.size();
+	}
+	if (opts.verbose) {
+		std::cout << "Read " << transfers.size() << " transfers with "
+				<< msgCount << " messages" << std::endl;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	size_t divergences = opts.device >= 0 ? replayDevice(opts, transfers)
+			: replayBatched(opts, transfers);
+	std::chrono::duration<double> elapsed
+			= std::chrono::steady_clock::now() - start;
+
+	std::cout << transfers.size() << " transfers, " << divergences
+			<< " divergent, " << (long)(transfers.size()
+					/ std::max(elapsed.count(), 1e-9))
+			<< " transfers/s" << std::endl;
+	return divergences == 0 ? 0 : 1;
+}
@@ -0,0 +1,608 @@
+/*
+ * VhostUser.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "VhostUser.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <endian.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/vhost_types.h>
+#include <linux/virtio_config.h>
+
+// The requests of the vhost-user protocol (frontend to backend)
+enum Request : uint32_t {
+	GetFeatures = 1,
+	SetFeatures = 2,
+	SetOwner = 3,
+	ResetOwner = 4,
+	SetMemTable = 5,
+	SetLogBase = 6,
+	SetLogFd = 7,
+	SetVringNum = 8,
+	SetVringAddr = 9,
+	SetVringBase = 10,
+	GetVringBase = 11,
+	SetVringKick = 12,
+	SetVringCall = 13,
+	SetVringErr = 14,
+	GetProtocolFeatures = 15,
+	SetProtocolFeatures = 16,
+	GetQueueNum = 17,
+	SetVringEnable = 18,
+};
+
+static constexpr uint32_t flagVersion = 0x1;
+static constexpr uint32_t flagReply = 0x4;
+static constexpr uint32_t flagNeedReply = 0x8;
+
+static constexpr int featureProtocolFeatures = 30;
+static constexpr int protocolMq = 0;
+static constexpr int protocolReplyAck = 3;
+
+/** Set in the payload of SET_VRING_KICK/CALL/ERR if no fd is passed. */
+static constexpr uint64_t vringNoFd = 0x100;
+static constexpr int maxRegions = 8;
+static constexpr uint32_t maxQueueSize = 32768;
+
+struct MemoryRegion {
+	uint64_t guestAddr;
+	uint64_t size;
+	uint64_t userAddr;
+	uint64_t offset;
+};
+
+struct MemoryTable {
+	uint32_t nregions;
+	uint32_t padding;
+	MemoryRegion regions[maxRegions];
+};
+
+/**
+ * A message, the payload's size depends on the request. On the
+ * socket, the payload immediately follows the header fields.
+ */
+struct VhostUserMessage {
+	uint32_t request;
+	uint32_t flags;
+	uint32_t size;
+	union {
+		uint64_t u64;
+		struct vhost_vring_state state;
+		struct vhost_vring_addr addr;
+		MemoryTable memory;
+	} payload;
+};
+
+static constexpr size_t headerSize = 3 * sizeof(uint32_t);
+
+bool GuestMemory::add(int fd, uint64_t guestAddr, uint64_t size,
+		uint64_t userAddr, uint64_t offset) {
+	void *mapped = mmap(nullptr, size + offset, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_NORESERVE, fd, 0);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	regions.push_back({ guestAddr, size, userAddr,
+		static_cast<uint8_t*>(mapped), size + offset });
+	return true;
+}
+
+void GuestMemory::clear() {
+	for (Region& region : regions) {
+		munmap(region.mapped, region.mappedSize);
+	}
+	regions.clear();
+}
+
+void* GuestMemory::fromGuest(uint64_t addr, uint64_t len) const {
+	for (const Region& region : regions) {
+		if (addr >= region.guestAddr && addr - region.guestAddr <= region.size
+				&& len <= region.size - (addr - region.guestAddr)) {
+			return region.mapped + region.mappedSize - region.size
+					+ (addr - region.guestAddr);
+		}
+	}
+	return nullptr;
+}
+
+void* GuestMemory::fromUser(uint64_t addr, uint64_t len) const {
+	for (const Region& region : regions) {
+		if (addr >= region.userAddr && addr - region.userAddr <= region.size
+				&& len <= region.size - (addr - region.userAddr)) {
+			return fromGuest(region.guestAddr + (addr - region.userAddr), len);
+		}
+	}
+	return nullptr;
+}
+
+bool Vring::map(const GuestMemory& memory) {
+	desc = static_cast<struct vring_desc*>(memory.fromUser(descAddr,
+			sizeof(struct vring_desc) * num));
+	avail = static_cast<struct vring_avail*>(memory.fromUser(availAddr,
+			sizeof(struct vring_avail) + sizeof(uint16_t) * (num + 1)));
+	used = static_cast<struct vring_used*>(memory.fromUser(usedAddr,
+			sizeof(struct vring_used) + sizeof(struct vring_used_elem) * num
+			+ sizeof(uint16_t)));
+	if (!desc || !avail || !used) {
+		desc = nullptr;
+		return false;
+	}
+	// Continue where the previous backend (if any) has stopped
+	usedIdx = le16toh(used->idx);
+	pushed = 0;
+	return true;
+}
+
+void Vring::reset() {
+	for (int *fd : { &kickFd, &callFd, &errFd }) {
+		if (*fd >= 0) {
+			close(*fd);
+			*fd = -1;
+		}
+	}
+	desc = nullptr;
+	avail = nullptr;
+	used = nullptr;
+	num = 0;
+	enabled = false;
+	broken = false;
+	lastAvail = 0;
+	usedIdx = 0;
+	pushed = 0;
+}
+
+bool Vring::empty() const {
+	return le16toh(__atomic_load_n(&avail->idx, __ATOMIC_ACQUIRE))
+			== lastAvail;
+}
+
+/**
+ * Marks the ring as broken. It isn't processed any more until
+ * the frontend resets it.
+ */
+static bool breakRing(Vring& vring, const char *reason) {
+	std::cerr << "Virtqueue broken: " << reason << std::endl;
+	vring.broken = true;
+	if (vring.errFd >= 0) {
+		eventfd_write(vring.errFd, 1);
+	}
+	return false;
+}
+
+bool Vring::pop(const GuestMemory& memory, Request& request) {
+	if (!ready()) {
+		return false;
+	}
+	uint16_t availIdx = le16toh(__atomic_load_n(&avail->idx,
+			__ATOMIC_ACQUIRE));
+	if (availIdx == lastAvail) {
+		return false;
+	}
+	if ((uint16_t)(availIdx - lastAvail) > num) {
+		return breakRing(*this, "invalid available index");
+	}
+	uint16_t head = le16toh(avail->ring[lastAvail % num]);
+	lastAvail++;
+
+	request.head = head;
+	request.buffers.clear();
+	uint16_t index = head;
+	for (uint32_t count = 0;; count++) {
+		if (index >= num || count >= num) {
+			return breakRing(*this, "invalid descriptor chain");
+		}
+		const struct vring_desc& descriptor = desc[index];
+		uint16_t flags = le16toh(descriptor.flags);
+		uint32_t len = le32toh(descriptor.len);
+		if (flags & VRING_DESC_F_INDIRECT) {
+			return breakRing(*this, "indirect descriptor not negotiated");
+		}
+		uint8_t *addr = static_cast<uint8_t*>(memory.fromGuest(
+				le64toh(descriptor.addr), len));
+		if (!addr && len > 0) {
+			return breakRing(*this, "descriptor outside guest memory");
+		}
+		request.buffers.push_back({ addr, len,
+			(flags & VRING_DESC_F_WRITE) != 0 });
+		if (!(flags & VRING_DESC_F_NEXT)) {
+			return true;
+		}
+		index = le16toh(descriptor.next);
+	}
+}
+
+void Vring::push(const Request& request, uint32_t written) {
+	struct vring_used_elem& elem = used->ring[(uint16_t)(usedIdx + pushed)
+			% num];
+	elem.id = htole32(request.head);
+	elem.len = htole32(written);
+	pushed++;
+}
+
+void Vring::flush() {
+	if (pushed == 0) {
+		return;
+	}
+	usedIdx += pushed;
+	pushed = 0;
+	__atomic_store_n(&used->idx, htole16(usedIdx), __ATOMIC_RELEASE);
+	// The guest's flags must be read after publishing the index
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!(le16toh(avail->flags) & VRING_AVAIL_F_NO_INTERRUPT)
+			&& callFd >= 0) {
+		eventfd_write(callFd, 1);
+	}
+}
+
+void Vring::notifications(bool enable) {
+	used->flags = htole16(enable ? 0 : VRING_USED_F_NO_NOTIFY);
+	if (enable) {
+		// Published before the available ring is checked again
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+VhostUser::VhostUser(int queues, uint64_t deviceFeatures)
+		: deviceFeatures(deviceFeatures), vrings(queues) {
+}
+
+VhostUser::~VhostUser() {
+}
+
+void VhostUser::resetDevice() {
+	for (Vring& vring : vrings) {
+		vring.reset();
+	}
+	memory.clear();
+	features = 0;
+	protocolFeatures = 0;
+}
+
+/**
+ * Receives a message and the file descriptors passed with it.
+ * Returns 0 if the frontend has disconnected, -1 on error.
+ */
+int VhostUser::receive(int fd, VhostUserMessage& msg, std::vector<int>& fds) {
+	char control[CMSG_SPACE(maxRegions * sizeof(int))];
+	struct iovec iov = { &msg, headerSize };
+	struct msghdr header;
+	std::memset(&header, 0, sizeof(header));
+	header.msg_iov = &iov;
+	header.msg_iovlen = 1;
+	header.msg_control = control;
+	header.msg_controllen = sizeof(control);
+
+	fds.clear();
+	ssize_t res = recvmsg(fd, &header, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+	if (res <= 0) {
+		return res;
+	}
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg;
+			cmsg = CMSG_NXTHDR(&header, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			int *passed = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+			fds.insert(fds.end(), passed, passed + count);
+		}
+	}
+	if ((size_t)res != headerSize || msg.size > sizeof(msg.payload)
+			|| (msg.size > 0 && recv(fd, &msg.payload, msg.size,
+					MSG_WAITALL) != (ssize_t)msg.size)) {
+		return -1;
+	}
+	return 1;
+}
+
+bool VhostUser::reply(int fd, VhostUserMessage& msg) {
+	msg.flags = flagVersion | flagReply;
+	struct iovec iov[] = { { &msg, headerSize }, { &msg.payload, msg.size } };
+	struct msghdr header;
+	std::memset(&header, 0, sizeof(header));
+	header.msg_iov = iov;
+	header.msg_iovlen = 2;
+	return sendmsg(fd, &header, MSG_NOSIGNAL)
+			== (ssize_t)(headerSize + msg.size);
+}
+
+/**
+ * Returns the ring addressed by the index, nullptr if invalid.
+ */
+static Vring* vringAt(std::vector<Vring>& vrings, uint32_t index) {
+	return index < vrings.size() ? &vrings[index] : nullptr;
+}
+
+/**
+ * Handles a message. Returns 0 on success, -1 if the request
+ * failed or isn't supported. Requests that return a value reply
+ * immediately and set replied.
+ */
+int VhostUser::handle(VhostUserMessage& msg, std::vector<int>& fds, bool& replied) {
+	Vring *vring;
+
+	replied = false;
+	switch (msg.request) {
+	case GetFeatures:
+		msg.payload.u64 = deviceFeatures | (1ULL << VIRTIO_F_VERSION_1)
+				| (1ULL << featureProtocolFeatures);
+		msg.size = sizeof(msg.payload.u64);
+		replied = true;
+		return 0;
+
+	case SetFeatures:
+		features = msg.payload.u64;
+		return 0;
+
+	case GetProtocolFeatures:
+		msg.payload.u64 = (1ULL << protocolMq) | (1ULL << protocolReplyAck);
+		msg.size = sizeof(msg.payload.u64);
+		replied = true;
+		return 0;
+
+	case SetProtocolFeatures:
+		protocolFeatures = msg.payload.u64;
+		return 0;
+
+	case GetQueueNum:
+		msg.payload.u64 = vrings.size();
+		msg.size = sizeof(msg.payload.u64);
+		replied = true;
+		return 0;
+
+	case SetOwner:
+		return 0;
+
+	case ResetOwner:
+		resetDevice();
+		return 0;
+
+	case SetMemTable: {
+		MemoryTable& table = msg.payload.memory;
+		if (table.nregions > maxRegions || fds.size() != table.nregions) {
+			return -1;
+		}
+		memory.clear();
+		for (uint32_t i = 0; i < table.nregions; i++) {
+			MemoryRegion& region = table.regions[i];
+			if (!memory.add(fds[i], region.guestAddr, region.size,
+					region.userAddr, region.offset)) {
+				return -1;
+			}
+		}
+		// Rings may be moved by a new table
+		for (Vring& ring : vrings) {
+			if (ring.num > 0 && ring.descAddr) {
+				ring.map(memory);
+			}
+		}
+		return 0;
+	}
+
+	case SetVringNum:
+		vring = vringAt(vrings, msg.payload.state.index);
+		if (!vring || msg.payload.state.num == 0
+				|| msg.payload.state.num > maxQueueSize
+				|| (msg.payload.state.num & (msg.payload.state.num - 1))) {
+			return -1;
+		}
+		vring->num = msg.payload.state.num;
+		return 0;
+
+	case SetVringAddr:
+		vring = vringAt(vrings, msg.payload.addr.index);
+		if (!vring || vring->num == 0) {
+			return -1;
+		}
+		vring->descAddr = msg.payload.addr.desc_user_addr;
+		vring->availAddr = msg.payload.addr.avail_user_addr;
+		vring->usedAddr = msg.payload.addr.used_user_addr;
+		return vring->map(memory) ? 0 : -1;
+
+	case SetVringBase:
+		vring = vringAt(vrings, msg.payload.state.index);
+		if (!vring) {
+			return -1;
+		}
+		vring->lastAvail = msg.payload.state.num;
+		return 0;
+
+	case GetVringBase:
+		// Stops the ring, the frontend restarts it from the state
+		vring = vringAt(vrings, msg.payload.state.index);
+		if (!vring) {
+			return -1;
+		}
+		vring->flush();
+		msg.payload.state.num = vring->lastAvail;
+		msg.size = sizeof(msg.payload.state);
+		vring->reset();
+		replied = true;
+		return 0;
+
+	case SetVringKick:
+	case SetVringCall:
+	case SetVringErr: {
+		vring = vringAt(vrings, msg.payload.u64 & 0xff);
+		bool noFd = msg.payload.u64 & vringNoFd;
+		if (!vring || fds.size() != (noFd ? 0 : 1)) {
+			return -1;
+		}
+		int *target = msg.request == SetVringKick ? &vring->kickFd
+				: msg.request == SetVringCall ? &vring->callFd : &vring->errFd;
+		if (*target >= 0) {
+			close(*target);
+		}
+		*target = noFd ? -1 : fds[0];
+		fds.clear();
+		if (msg.request == SetVringKick && noFd) {
+			// Polling the ring isn't supported
+			return -1;
+		}
+		// Without protocol features, a ring is enabled when started
+		if (msg.request == SetVringKick
+				&& !(features & (1ULL << featureProtocolFeatures))) {
+			vring->enabled = true;
+		}
+		return 0;
+	}
+
+	case SetVringEnable:
+		vring = vringAt(vrings, msg.payload.state.index);
+		if (!vring) {
+			return -1;
+		}
+		vring->enabled = msg.payload.state.num != 0;
+		return 0;
+
+	default:
+		std::cerr << "Unsupported vhost-user request " << msg.request
+				<< std::endl;
+		return -1;
+	}
+}
+
+/**
+ * Processes the requests of a ring that has been kicked. The
+ * guest's kicks are disabled while processing, which saves
+ * the guest the exits while the backend is busy anyway.
+ */
+void VhostUser::kick(Vring& vring) {
+	eventfd_t value;
+	eventfd_read(vring.kickFd, &value);
+	do {
+		vring.notifications(false);
+		process(vring, memory);
+		vring.flush();
+		if (!vring.ready()) {
+			return;
+		}
+		vring.notifications(true);
+	} while (!vring.empty());
+}
+
+/**
+ * Serves the connected frontend until it disconnects. Returns
+ * false if interrupted by a signal.
+ */
+bool VhostUser::serveConnection(int fd) {
+	VhostUserMessage msg;
+	std::vector<int> fds;
+	std::vector<struct pollfd> polled;
+
+	while (true) {
+		polled.assign(1, { fd, POLLIN, 0 });
+		for (Vring& vring : vrings) {
+			if (vring.ready()) {
+				polled.push_back({ vring.kickFd, POLLIN, 0 });
+			}
+		}
+		if (poll(polled.data(), polled.size(), -1) < 0) {
+			return errno != EINTR;
+		}
+
+		// Kicks are handled before the messages that may stop rings
+		for (size_t i = 1; i < polled.size(); i++) {
+			if (!(polled[i].revents & POLLIN)) {
+				continue;
+			}
+			for (Vring& vring : vrings) {
+				if (vring.kickFd == polled[i].fd && vring.ready()) {
+					kick(vring);
+				}
+			}
+		}
+		if (!(polled[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+			continue;
+		}
+
+		int res = receive(fd, msg, fds);
+		if (res <= 0) {
+			if (res < 0) {
+				std::cerr << "Invalid vhost-user message" << std::endl;
+			}
+			for (int passed : fds) {
+				close(passed);
+			}
+			return true;
+		}
+		if (debug) {
+			std::cerr << "vhost-user request " << msg.request << ", "
+					<< fds.size() << " fds" << std::endl;
+		}
+		bool replied;
+		int result = handle(msg, fds, replied);
+		// The regions' fds aren't needed after mapping
+		for (int passed : fds) {
+			close(passed);
+		}
+		if (replied) {
+			if (!reply(fd, msg)) {
+				return true;
+			}
+		} else if ((msg.flags & flagNeedReply)
+				&& (protocolFeatures & (1ULL << protocolReplyAck))) {
+			msg.payload.u64 = result == 0 ? 0 : 1;
+			msg.size = sizeof(msg.payload.u64);
+			if (!reply(fd, msg)) {
+				return true;
+			}
+		}
+	}
+}
+
+bool VhostUser::serve(const std::string& path) {
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener < 0) {
+		return false;
+	}
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		close(listener);
+		return false;
+	}
+	std::strcpy(addr.sun_path, path.c_str());
+	unlink(path.c_str());
+	if (bind(listener, reinterpret_cast<struct sockaddr*>(&addr),
+			sizeof(addr)) < 0 || listen(listener, 1) < 0) {
+		close(listener);
+		return false;
+	}
+
+	while (true) {
+		int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR) {
+				break;
+			}
+			continue;
+		}
+		if (debug) {
+			std::cerr << "Frontend connected" << std::endl;
+		}
+		bool proceed = serveConnection(fd);
+		close(fd);
+		// The device state is lost when the frontend disconnects
+		resetDevice();
+		if (debug) {
+			std::cerr << "Frontend disconnected" << std::endl;
+		}
+		if (!proceed) {
+			break;
+		}
+	}
+	close(listener);
+	unlink(path.c_str());
+	return true;
+}
@@ -0,0 +1,206 @@
+/*
+ * VhostUser.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef I2C_VHOST_SIM_VHOSTUSER_H_
+#define I2C_VHOST_SIM_VHOSTUSER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+// The legacy helpers don't compile as C++
+#define VIRTIO_RING_NO_LEGACY
+#include <linux/virtio_ring.h>
+
+/**
+ * The guest's memory, as passed by the frontend with
+ * VHOST_USER_SET_MEM_TABLE. The regions are mapped into the
+ * daemon's address space, so buffers can be accessed in place.
+ */
+class GuestMemory {
+public:
+	GuestMemory() = default;
+	GuestMemory(const GuestMemory&) = delete;
+	GuestMemory& operator=(const GuestMemory&) = delete;
+	~GuestMemory() { clear(); }
+
+	/**
+	 * Maps a region. The guest physical address, the frontend's
+	 * (QEMU's) virtual address and the offset of the region in the
+	 * file are those of the message. Returns false if mapping fails.
+	 */
+	bool add(int fd, uint64_t guestAddr, uint64_t size, uint64_t userAddr,
+			uint64_t offset);
+
+	/** Unmaps all regions. */
+	void clear();
+
+	/**
+	 * Returns the local address for the range of guest physical
+	 * addresses, nullptr if the range isn't completely within
+	 * a region.
+	 */
+	void* fromGuest(uint64_t addr, uint64_t len) const;
+
+	/** As fromGuest, for an address in the frontend's address space. */
+	void* fromUser(uint64_t addr, uint64_t len) const;
+
+private:
+	struct Region {
+		uint64_t guestAddr;
+		uint64_t size;
+		uint64_t userAddr;
+		uint8_t *mapped;
+		uint64_t mappedSize;
+	};
+	std::vector<Region> regions;
+};
+
+/**
+ * A split virtqueue. The requests are taken from the available
+ * ring with pop() and returned to the guest with push(). The used
+ * ring's index is only published (and the guest notified) by
+ * flush(), so a batch of requests causes a single interrupt.
+ */
+class Vring {
+public:
+	/** A buffer of a request, in the daemon's address space. */
+	struct Buffer {
+		uint8_t *addr;
+		uint32_t len;
+		bool writable;
+	};
+
+	/**
+	 * A request, i.e. a descriptor chain. Reused for subsequent
+	 * requests to avoid allocations.
+	 */
+	struct Request {
+		uint16_t head;
+		std::vector<Buffer> buffers;
+	};
+
+	uint32_t num = 0;
+	uint64_t descAddr = 0;
+	uint64_t availAddr = 0;
+	uint64_t usedAddr = 0;
+	int kickFd = -1;
+	int callFd = -1;
+	int errFd = -1;
+	bool enabled = false;
+	/** Set if the guest has violated the protocol. */
+	bool broken = false;
+	/** The index of the next request in the available ring. */
+	uint16_t lastAvail = 0;
+
+	Vring() = default;
+	Vring(const Vring&) = delete;
+	Vring& operator=(const Vring&) = delete;
+	~Vring() { reset(); }
+
+	/**
+	 * Translates the ring addresses (frontend addresses). Returns
+	 * false if the rings aren't mapped.
+	 */
+	bool map(const GuestMemory& memory);
+
+	/** Unmaps the rings and closes the file descriptors. */
+	void reset();
+
+	/** Requests are processed when started and enabled. */
+	bool ready() const { return desc && kickFd >= 0 && enabled && !broken; }
+
+	/** Checks if the guest has made requests available. */
+	bool empty() const;
+
+	/**
+	 * Gets the next available request. Returns false if there
+	 * is none. Invalid descriptors break the ring.
+	 */
+	bool pop(const GuestMemory& memory, Request& request);
+
+	/**
+	 * Returns the request to the guest with the number of bytes
+	 * written to its buffers.
+	 */
+	void push(const Request& request, uint32_t written);
+
+	/**
+	 * Makes the pushed requests visible to the guest and notifies
+	 * the guest unless it has disabled interrupts.
+	 */
+	void flush();
+
+	/**
+	 * Enables or disables the guest's notifications (kicks). After
+	 * enabling them, the available ring must be checked again.
+	 */
+	void notifications(bool enable);
+
+private:
+	struct vring_desc *desc = nullptr;
+	struct vring_avail *avail = nullptr;
+	struct vring_used *used = nullptr;
+	uint16_t usedIdx = 0;
+	uint16_t pushed = 0;
+};
+
+struct VhostUserMessage;
+
+/**
+ * A vhost-user backend, i.e. the device side of a virtio device
+ * whose virtqueues are processed outside the VMM. Implements the
+ * protocol on the socket connected to the frontend (QEMU), the
+ * device specific processing is provided by a derived class.
+ */
+class VhostUser {
+public:
+	/**
+	 * Creates a backend with the given number of queues that
+	 * supports the given (device specific) features.
+	 */
+	VhostUser(int queues, uint64_t deviceFeatures);
+	VhostUser(const VhostUser&) = delete;
+	VhostUser& operator=(const VhostUser&) = delete;
+	virtual ~VhostUser();
+
+	/**
+	 * Listens on the given socket and serves one frontend at a
+	 * time, until a signal interrupts waiting. Returns false
+	 * if the socket cannot be created.
+	 */
+	bool serve(const std::string& path);
+
+	/** Enables the protocol trace. */
+	void setDebug(bool debug) { this->debug = debug; }
+
+protected:
+	/** The negotiated features. */
+	uint64_t features = 0;
+
+	/**
+	 * Processes the available requests of the queue, invoked when
+	 * the guest has kicked the queue. The processed requests are
+	 * pushed, the caller flushes the ring.
+	 */
+	virtual void process(Vring& vring, const GuestMemory& memory) = 0;
+
+private:
+	uint64_t deviceFeatures;
+	uint64_t protocolFeatures = 0;
+	std::vector<Vring> vrings;
+	GuestMemory memory;
+	bool debug = false;
+
+	bool serveConnection(int fd);
+	int receive(int fd, VhostUserMessage& msg, std::vector<int>& fds);
+	bool reply(int fd, VhostUserMessage& msg);
+	int handle(VhostUserMessage& msg, std::vector<int>& fds, bool& replied);
+	void kick(Vring& vring);
+	void resetDevice();
+};
+
+#endif /* I2C_VHOST_SIM_VHOSTUSER_H_ */
@@ -0,0 +1,213 @@
+/*
+ * i2c-vhost-sim.cpp
+ *
+ * A vhost-user-i2c backend that serves the requests of a guest's
+ * virtio-i2c driver with the simulated devices. The messages of
+ * a transfer are executed with the buffers in the guest's memory,
+ * nothing is copied.
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <endian.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/virtio_i2c.h>
+
+#include "Bus.h"
+#include "TestDevices.h"
+#include "VhostUser.h"
+
+/**
+ * The virtio-i2c device. The driver queues each message of a
+ * transfer as a request with an out header (address and flags),
+ * the message's buffer (unless zero length) and an in header for
+ * the status. All but the last request of a transfer have
+ * VIRTIO_I2C_FLAGS_FAIL_NEXT set.
+ */
+class I2cBackend : public VhostUser {
+public:
+	explicit I2cBackend(sim::Bus& bus)
+			: VhostUser(1, 1ULL << VIRTIO_I2C_F_ZERO_LENGTH_REQUEST),
+			  bus(bus) {}
+
+protected:
+	void process(Vring& vring, const GuestMemory& memory) override;
+
+private:
+	/** A request of the transfer being collected. */
+	struct Pending {
+		uint16_t head;
+		uint8_t *status;
+		bool valid;
+	};
+
+	sim::Bus& bus;
+	Vring::Request request;
+	std::vector<struct i2c_msg> msgs;
+	std::vector<Pending> pending;
+	/** The buffer for messages without data. */
+	uint8_t scratch[1];
+
+	bool parse(struct i2c_msg& msg, uint8_t *&status, uint32_t& flags);
+	void execute(Vring& vring);
+};
+
+/**
+ * Converts the request to a message that refers to the request's
+ * buffer. Returns false if the request is invalid. Buffers that
+ * consist of several descriptors aren't supported (the Linux driver
+ * uses a single one). The status is nullptr and the flags are 0
+ * if the request has no valid in or out header.
+ */
+bool I2cBackend::parse(struct i2c_msg& msg, uint8_t *&status,
+		uint32_t& flags) {
+	std::vector<Vring::Buffer>& buffers = request.buffers;
+
+	status = nullptr;
+	flags = 0;
+	if (buffers.size() < 2) {
+		return false;
+	}
+	Vring::Buffer& in = buffers.back();
+	if (in.writable && in.len >= sizeof(struct virtio_i2c_in_hdr)) {
+		status = in.addr;
+	}
+	Vring::Buffer& out = buffers.front();
+	if (out.writable || out.len < sizeof(struct virtio_i2c_out_hdr)) {
+		return false;
+	}
+	struct virtio_i2c_out_hdr header;
+	std::memcpy(&header, out.addr, sizeof(header));
+	flags = le32toh(header.flags);
+	if (!status) {
+		return false;
+	}
+
+	msg.addr = le16toh(header.addr) >> 1;
+	msg.flags = (flags & VIRTIO_I2C_FLAGS_M_RD) ? I2C_M_RD : 0;
+	msg.len = 0;
+	msg.buf = scratch;
+	if (buffers.size() == 2) {
+		return features & (1ULL << VIRTIO_I2C_F_ZERO_LENGTH_REQUEST);
+	}
+	Vring::Buffer& data = buffers[1];
+	if (buffers.size() > 3 || data.writable != !!(msg.flags & I2C_M_RD)
+			|| data.len > 0xffff || msg.addr > 0x7f) {
+		return false;
+	}
+	if (data.len > 0) {
+		msg.len = data.len;
+		msg.buf = data.addr;
+	}
+	return true;
+}
+
+/**
+ * Executes the collected requests as a transfer. A transfer
+ * succeeds or fails as a whole, so all requests get the same
+ * status.
+ */
+void I2cBackend::execute(Vring& vring) {
+	bool valid = true;
+	for (Pending& entry : pending) {
+		valid = valid && entry.valid;
+	}
+	int res = valid ? bus.transfer(msgs.data(), msgs.size()) : -EINVAL;
+	for (size_t i = 0; i < pending.size(); i++) {
+		uint32_t written = 0;
+		if (pending[i].status) {
+			*pending[i].status = res == (int)msgs.size() ? VIRTIO_I2C_MSG_OK
+					: VIRTIO_I2C_MSG_ERR;
+			written = sizeof(struct virtio_i2c_in_hdr);
+			if (res >= 0 && (msgs[i].flags & I2C_M_RD)
+					&& msgs[i].buf != scratch) {
+				written += msgs[i].len;
+			}
+		}
+		request.head = pending[i].head;
+		vring.push(request, written);
+	}
+	msgs.clear();
+	pending.clear();
+}
+
+/**
+ * Collects the requests of a transfer and executes them when the
+ * last one has been received. If the guest hasn't queued the last
+ * request of a transfer, the requests queued so far are executed.
+ */
+void I2cBackend::process(Vring& vring, const GuestMemory& memory) {
+	while (vring.pop(memory, request)) {
+		msgs.emplace_back();
+		uint8_t *status;
+		uint32_t flags;
+		bool valid = parse(msgs.back(), status, flags);
+		pending.push_back({ request.head, status, valid });
+		if (!(flags & VIRTIO_I2C_FLAGS_FAIL_NEXT)) {
+			execute(vring);
+		}
+	}
+	if (!pending.empty()) {
+		execute(vring);
+	}
+}
+
+static void usage(const char *name) {
+	std::cerr << "Usage: " << name << " [-d] -s socket" << std::endl;
+}
+
+/** Interrupts waiting, without terminating the process. */
+static void onSignal(int) {
+}
+
+int main(int argc, char **argv) {
+	std::string socketPath;
+	bool debug = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ds:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			debug = true;
+			break;
+		case 's':
+			socketPath = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (socketPath.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// The guest numbers its adapter, the number only affects the hubs
+	sim::Bus bus(1);
+	sim::attachTestDevices(bus);
+	I2cBackend backend(bus);
+	backend.setDebug(debug);
+
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	action.sa_handler = onSignal;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	std::cout << "Waiting for frontend on " << socketPath << std::endl;
+	if (!backend.serve(socketPath)) {
+		std::cerr << "Cannot listen on " << socketPath << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+    i2c-virt-batch.c - Executes batches of transfers written to debugfs
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+*/
+
+#define DEBUG 1
+#define pr_fmt(fmt) "i2c-virt-batch: " fmt
+
+#include <linux/debugfs.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include "i2c-virt-batch.h"
+#include "i2c-virt-hub.h"
+
+/**
+ * The state associated with an open batch file.
+ */
+struct virt_batch {
+	struct mutex lock;
+	/** The results of the last batch written. */
+	u8 *results;
+	size_t results_len;
+};
+
+/**
+ * The additional space required in the results for a read message.
+ */
+static size_t virt_batch_reserve(const struct i2c_virt_batch_msg *msg) {
+	return msg->len
+			+ ((msg->flags & I2C_M_RECV_LEN) ? I2C_SMBUS_BLOCK_MAX : 0);
+}
+
+/*
+ * Checks the batch. Returns the space required for the results
+ * (before the data of I2C_M_RECV_LEN messages is compacted) or
+ * negative errno.
+ */
+static ssize_t virt_batch_check(const u8 *batch, size_t size) {
+	struct i2c_virt_batch_xfer xfer;
+	struct i2c_virt_batch_msg msg;
+	size_t pos = 0;
+	size_t required = 0;
+	u32 i;
+
+	while (pos < size) {
+		if (size - pos < sizeof(xfer)) {
+			return -EINVAL;
+		}
+		memcpy(&xfer, batch + pos, sizeof(xfer));
+		pos += sizeof(xfer);
+		if (xfer.nmsgs == 0) {
+			return -EINVAL;
+		}
+		required += sizeof(struct i2c_virt_batch_result);
+		for (i = 0; i < xfer.nmsgs; i++) {
+			if (size - pos < sizeof(msg)) {
+				return -EINVAL;
+			}
+			memcpy(&msg, batch + pos, sizeof(msg));
+			pos += sizeof(msg);
+			if (msg.flags & ~(I2C_M_RD | I2C_M_RECV_LEN)) {
+				return -EINVAL;
+			}
+			if (msg.flags & I2C_M_RD) {
+				if (msg.len == 0) {
+					return -EINVAL;
+				}
+				required += virt_batch_reserve(&msg);
+				continue;
+			}
+			if ((msg.flags & I2C_M_RECV_LEN) || size - pos < msg.len) {
+				return -EINVAL;
+			}
+			pos += msg.len;
+		}
+	}
+	return required;
+}
+
+/*
+ * Executes the (checked) batch, storing the results in the context.
+ * The data of write messages is taken from the batch, the data of
+ * read messages is read directly into the results. The messages
+ * of a transfer are prepared in msgs, which has room for
+ * I2C_RDWR_IOCTL_MAX_MSGS messages.
+ */
+static void virt_batch_run(struct virt_batch *ctx, struct i2c_msg *msgs,
+		const u8 *batch, size_t size) {
+	struct i2c_virt_batch_xfer xfer;
+	struct i2c_virt_batch_msg msg;
+	struct i2c_virt_batch_result result;
+	size_t pos = 0;
+	size_t out = 0;
+	size_t data;
+	u32 i;
+
+	while (pos < size) {
+		memcpy(&xfer, batch + pos, sizeof(xfer));
+		pos += sizeof(xfer);
+		data = out + sizeof(result);
+		for (i = 0; i < xfer.nmsgs; i++) {
+			memcpy(&msg, batch + pos, sizeof(msg));
+			pos += sizeof(msg);
+			if (i >= I2C_RDWR_IOCTL_MAX_MSGS) {
+				// Too many messages, the transfer fails
+				pos += (msg.flags & I2C_M_RD) ? 0 : msg.len;
+				continue;
+			}
+			msgs[i].addr = msg.addr;
+			msgs[i].flags = msg.flags;
+			msgs[i].len = msg.len;
+			if (msg.flags & I2C_M_RD) {
+				msgs[i].buf = ctx->results + data;
+				data += virt_batch_reserve(&msg);
+			} else {
+				msgs[i].buf = (u8 *)batch + pos;
+				pos += msg.len;
+			}
+		}
+
+		result.ret = xfer.nmsgs > I2C_RDWR_IOCTL_MAX_MSGS ? -EINVAL
+				: i2c_transfer(&virt_master_adapter, msgs, xfer.nmsgs);
+
+		// Make the data of the read messages follow the result
+		result.len = 0;
+		for (i = 0; result.ret >= 0 && i < xfer.nmsgs; i++) {
+			if (!(msgs[i].flags & I2C_M_RD)) {
+				continue;
+			}
+			memmove(ctx->results + out + sizeof(result) + result.len,
+					msgs[i].buf, msgs[i].len);
+			result.len += msgs[i].len;
+		}
+		memcpy(ctx->results + out, &result, sizeof(result));
+		out += sizeof(result) + result.len;
+	}
+	ctx->results_len = out;
+}
+
+static int virt_batch_open(struct inode *inode, struct file *file) {
+	struct virt_batch *ctx;
+
+	ctx = kzalloc(sizeof(struct virt_batch), GFP_KERNEL);
+	if (!ctx) {
+		return -ENOMEM;
+	}
+	mutex_init(&ctx->lock);
+	file->private_data = ctx;
+	return 0;
+}
+
+static int virt_batch_release(struct inode *inode, struct file *file) {
+	struct virt_batch *ctx = file->private_data;
+
+	kvfree(ctx->results);
+	kfree(ctx);
+	return 0;
+}
+
+static ssize_t virt_batch_write(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct virt_batch *ctx = file->private_data;
+	struct i2c_msg *msgs;
+	ssize_t required;
+	ssize_t ret;
+	u8 *batch;
+
+	if (count == 0) {
+		return 0;
+	}
+	if (count > I2C_VIRT_BATCH_MAX) {
+		return -EFBIG;
+	}
+	batch = vmemdup_user(buf, count);
+	if (IS_ERR(batch)) {
+		return PTR_ERR(batch);
+	}
+	required = virt_batch_check(batch, count);
+	if (required < 0) {
+		ret = required;
+		goto free_batch;
+	}
+	msgs = kcalloc(I2C_RDWR_IOCTL_MAX_MSGS, sizeof(struct i2c_msg),
+			GFP_KERNEL);
+	if (!msgs) {
+		ret = -ENOMEM;
+		goto free_batch;
+	}
+
+	mutex_lock(&ctx->lock);
+	kvfree(ctx->results);
+	ctx->results_len = 0;
+	ctx->results = kvmalloc(required, GFP_KERNEL);
+	if (!ctx->results) {
+		ret = -ENOMEM;
+	} else {
+		virt_batch_run(ctx, msgs, batch, count);
+		ret = count;
+	}
+	mutex_unlock(&ctx->lock);
+	kfree(msgs);
+
+ free_batch:
+	kvfree(batch);
+	return ret;
+}
+
+static ssize_t virt_batch_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct virt_batch *ctx = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&ctx->lock);
+	ret = simple_read_from_buffer(buf, count, ppos,
+			ctx->results, ctx->results_len);
+	mutex_unlock(&ctx->lock);
+	return ret;
+}
+
+static const struct file_operations virt_batch_fops = {
+	.owner = THIS_MODULE,
+	.open = virt_batch_open,
+	.release = virt_batch_release,
+	.read = virt_batch_read,
+	.write = virt_batch_write,
+	.llseek = default_llseek,
+};
+
+void __init virt_batch_init(struct dentry *dir) {
+	debugfs_create_file("batch", 0600, dir, NULL, &virt_batch_fops);
+}
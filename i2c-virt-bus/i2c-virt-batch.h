@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later WITH Linux-syscall-note */
+/*
+    i2c-virt-batch.h - Format of the data exchanged with the batch file
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+    A batch, written to the file at one go, is a sequence of transfers.
+    Each transfer starts with a struct i2c_virt_batch_xfer that is
+    followed by nmsgs messages. Each message starts with a struct
+    i2c_virt_batch_msg. For write messages, the header is followed by
+    len bytes of data.
+
+    After the batch has been written, the results can be read from
+    the file. For each transfer, there is a struct
+    i2c_virt_batch_result that is followed by len bytes, the data
+    of all read messages of the transfer. For messages with
+    I2C_M_RECV_LEN, this includes the length byte.
+
+    As with I2C_RDWR, a transfer may have at most
+    I2C_RDWR_IOCTL_MAX_MSGS messages. A transfer with more messages
+    fails with EINVAL, the other transfers of the batch are executed.
+
+    All values use the host's byte order, the structures are packed
+    without padding between them.
+*/
+
+#ifndef I2C_VIRT_BATCH_H_
+#define I2C_VIRT_BATCH_H_
+
+#include <linux/types.h>
+
+/** The path of the file in debugfs. */
+#define I2C_VIRT_BATCH_PATH "/sys/kernel/debug/i2c-virt-bus/batch"
+
+/** The maximum size of the data written to the file at once. */
+#define I2C_VIRT_BATCH_MAX (1024 * 1024)
+
+struct i2c_virt_batch_xfer {
+	__u32 nmsgs;
+};
+
+struct i2c_virt_batch_msg {
+	__u16 addr;
+	/** Only I2C_M_RD and I2C_M_RECV_LEN are supported. */
+	__u16 flags;
+	__u16 len;
+	__u16 reserved;
+};
+
+struct i2c_virt_batch_result {
+	/** The result of i2c_transfer. */
+	__s32 ret;
+	__u32 len;
+};
+
+#endif /* I2C_VIRT_BATCH_H_ */
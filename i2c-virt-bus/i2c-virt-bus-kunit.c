@@ -0,0 +1,535 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+    i2c-virt-bus-kunit.c - KUnit tests and micro-benchmarks for the
+    transfer path, i.e. virt_master_xfer, the slave lookup and the
+    slave callbacks, without the overhead of i2c-dev.
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+*/
+
+#include <kunit/test.h>
+#include <linux/completion.h>
+#include <linux/delay.h>
+#include <linux/errno.h>
+#include <linux/i2c.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "i2c-virt-hub.h"
+
+/** Range of addresses used for the slaves created by the tests. */
+#define BENCH_FIRST_ADDR 0x08
+#define BENCH_LAST_ADDR 0x47
+
+#define BENCH_MAX_SLAVES 64
+/** Bytes transferred by each benchmark (at least 256 transfers). */
+#define BENCH_BYTES (64 * 1024)
+
+/**
+ * The state of a simulated slave: a register file with
+ * auto-incrementing register pointer (like a 24C02).
+ */
+struct bench_slave {
+	u8 regs[256];
+	u8 ptr;
+	bool ptr_set;
+};
+
+struct bench_ctx {
+	struct virt_hub *hub;
+	int nslaves;
+	struct i2c_client *slaves[BENCH_MAX_SLAVES];
+	struct bench_slave data[BENCH_MAX_SLAVES];
+};
+
+static int bench_slave_cb(struct i2c_client *client,
+		enum i2c_slave_event event, u8 *val) {
+	struct bench_slave *slave = i2c_get_clientdata(client);
+
+	switch (event) {
+	case I2C_SLAVE_WRITE_RECEIVED:
+		if (!slave->ptr_set) {
+			slave->ptr = *val;
+			slave->ptr_set = true;
+		} else {
+			slave->regs[slave->ptr++] = *val;
+		}
+		break;
+
+	case I2C_SLAVE_READ_REQUESTED:
+	case I2C_SLAVE_READ_PROCESSED:
+		*val = slave->regs[slave->ptr++];
+		break;
+
+	case I2C_SLAVE_WRITE_REQUESTED:
+		slave->ptr_set = false;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * Creates a slave at the next free address in the range from *addr
+ * to last and updates *addr to the address following the slave.
+ * If a callback is given, registers the slave with the callback,
+ * else the slave is expected to be registered by its driver.
+ * Returns the client or an error pointer.
+ */
+static struct i2c_client *bench_add_slave(struct virt_hub *hub,
+		const char *type, u16 *addr, u16 last, i2c_slave_cb_t cb,
+		void *data) {
+	struct i2c_board_info info = { .flags = I2C_CLIENT_SLAVE };
+	struct i2c_client *client;
+	int ret;
+
+	strscpy(info.type, type, sizeof(info.type));
+	for (; *addr <= last; (*addr)++) {
+		info.addr = *addr;
+		client = i2c_new_client_device(&hub->adap, &info);
+		if (IS_ERR(client)) {
+			continue;
+		}
+		if (cb) {
+			i2c_set_clientdata(client, data);
+			ret = i2c_slave_register(client, cb);
+			if (ret) {
+				i2c_unregister_device(client);
+				continue;
+			}
+		}
+		(*addr)++;
+		return client;
+	}
+	return ERR_PTR(-EBUSY);
+}
+
+static int virt_bus_test_init(struct kunit *test) {
+	struct bench_ctx *ctx;
+
+	ctx = kunit_kzalloc(test, sizeof(struct bench_ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+	ctx->hub = i2c_get_adapdata(&virt_master_adapter);
+	test->priv = ctx;
+	return 0;
+}
+
+static void virt_bus_test_exit(struct kunit *test) {
+	struct bench_ctx *ctx = test->priv;
+	int i;
+
+	for (i = 0; i < ctx->nslaves; i++) {
+		// Slaves with driver are unregistered by the driver
+		if (!ctx->slaves[i]->dev.driver && ctx->slaves[i]->slave_cb) {
+			i2c_slave_unregister(ctx->slaves[i]);
+		}
+		i2c_unregister_device(ctx->slaves[i]);
+	}
+}
+
+static void bench_add_slaves(struct kunit *test, int count) {
+	struct bench_ctx *ctx = test->priv;
+	struct i2c_client *client;
+	u16 addr = BENCH_FIRST_ADDR;
+
+	while (ctx->nslaves < count) {
+		client = bench_add_slave(ctx->hub, "virt-bench", &addr,
+				BENCH_LAST_ADDR, bench_slave_cb,
+				&ctx->data[ctx->nslaves]);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, client);
+		ctx->slaves[ctx->nslaves++] = client;
+	}
+}
+
+/*
+ * Write some registers and read them back.
+ */
+static void virt_bus_test_xfer(struct kunit *test) {
+	struct bench_ctx *ctx = test->priv;
+	u8 out[] = { 0x10, 0x12, 0x34, 0x56 };
+	u8 in[3] = { 0 };
+	struct i2c_msg msgs[2];
+	u16 addr;
+
+	bench_add_slaves(test, 1);
+	addr = ctx->slaves[0]->addr;
+
+	msgs[0] = (struct i2c_msg) { .addr = addr, .len = 4, .buf = out };
+	KUNIT_ASSERT_EQ(test, i2c_transfer(&virt_master_adapter, msgs, 1), 1);
+
+	msgs[0].len = 1;
+	msgs[1] = (struct i2c_msg) {
+		.addr = addr, .flags = I2C_M_RD, .len = 3, .buf = in };
+	KUNIT_ASSERT_EQ(test, i2c_transfer(&virt_master_adapter, msgs, 2), 2);
+	KUNIT_EXPECT_EQ(test, in[0], 0x12);
+	KUNIT_EXPECT_EQ(test, in[1], 0x34);
+	KUNIT_EXPECT_EQ(test, in[2], 0x56);
+}
+
+/*
+ * Transfers to an address without slave fail.
+ */
+static void virt_bus_test_no_slave(struct kunit *test) {
+	struct bench_ctx *ctx = test->priv;
+	u8 out[] = { 0 };
+	struct i2c_msg msg = { .len = 1, .buf = out };
+
+	bench_add_slaves(test, 1);
+	msg.addr = ctx->slaves[0]->addr + 1;
+	while (virt_hub_find_slave(ctx->hub, msg.addr)) {
+		msg.addr++;
+	}
+	KUNIT_EXPECT_EQ(test, i2c_transfer(&virt_master_adapter, &msg, 1),
+			-ENODEV);
+}
+
+/**
+ * Decodes the VCD text into a summary of the transfers, using the
+ * levels of SDA at the rising edges of SCL. A start condition is
+ * appended as "S ", a byte as its value followed by "A" or "N"
+ * (ACK or NACK) and a stop condition as "P ".
+ */
+static void vcd_decode(char *text, char *out, size_t size) {
+	size_t len = 0;
+	u8 scl = 1;
+	u8 sda = 1;
+	int bits = 0;
+	u8 byte = 0;
+	char *line;
+	u8 value;
+
+	out[0] = 0;
+	while ((line = strsep(&text, "\n")) != NULL) {
+		if (strlen(line) != 2 || (line[0] != '0' && line[0] != '1')) {
+			continue;
+		}
+		value = line[0] - '0';
+		if (line[1] == '!') {
+			if (!scl && value) {
+				bits++;
+				if (bits <= 8) {
+					byte = byte << 1 | sda;
+				} else {
+					len += scnprintf(out + len, size - len, "%02x%c ",
+							byte, sda ? 'N' : 'A');
+					bits = 0;
+				}
+			}
+			scl = value;
+		} else if (line[1] == '"') {
+			if (scl && sda != value) {
+				len += scnprintf(out + len, size - len,
+						value ? "P " : "S ");
+				bits = 0;
+			}
+			sda = value;
+		}
+	}
+}
+
+/*
+ * The waveform exported while recording shows the address and data
+ * bytes of the transfers, NACKed if there is no slave.
+ */
+static void virt_bus_test_vcd(struct kunit *test) {
+	struct bench_ctx *ctx = test->priv;
+	struct vcd_reader *reader;
+	u8 out[] = { 0x10, 0x12 };
+	struct i2c_msg msg = { .len = 2, .buf = out };
+	char expected[64];
+	size_t text_size = 16 * PAGE_SIZE;
+	char *text;
+	char *summary;
+	size_t len;
+	u16 absent;
+
+	text = kunit_kzalloc(test, text_size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, text);
+	summary = kunit_kzalloc(test, 256, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, summary);
+	bench_add_slaves(test, 1);
+	absent = ctx->slaves[0]->addr + 1;
+	while (virt_hub_find_slave(ctx->hub, absent)) {
+		absent++;
+	}
+
+	reader = virt_vcd_begin();
+	if (IS_ERR(reader)) {
+		kunit_skip(test, "vcd is being read");
+	}
+	msg.addr = ctx->slaves[0]->addr;
+	KUNIT_EXPECT_EQ(test, i2c_transfer(&virt_master_adapter, &msg, 1), 1);
+	msg.addr = absent;
+	KUNIT_EXPECT_EQ(test, i2c_transfer(&virt_master_adapter, &msg, 1),
+			-ENODEV);
+	len = virt_vcd_text(reader, text, text_size - 1);
+	virt_vcd_end(reader);
+	text[len] = 0;
+
+	KUNIT_EXPECT_NOT_NULL(test, strstr(text, "$enddefinitions $end"));
+	vcd_decode(text, summary, 256);
+	snprintf(expected, sizeof(expected), "S %02xA 10A 12A P S %02xN P ",
+			ctx->slaves[0]->addr << 1, absent << 1);
+	KUNIT_EXPECT_STREQ(test, summary, expected);
+}
+
+/** Time (ms) that each worker holds the bus in the first round. */
+#define QOS_HOLD_MS 10
+
+/**
+ * A client of the scheduler. The worker holds the bus for
+ * QOS_HOLD_MS, then waits for "go" and acquires the bus again,
+ * appending its name to the log.
+ */
+struct qos_worker {
+	struct task_struct *task;
+	char name;
+	char *log;
+	struct completion held;
+	struct completion go;
+	struct completion done;
+};
+
+static int qos_worker_fn(void *data) {
+	struct qos_worker *worker = data;
+
+	virt_qos_lock_ops.lock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	msleep(QOS_HOLD_MS);
+	virt_qos_lock_ops.unlock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	complete(&worker->held);
+
+	wait_for_completion(&worker->go);
+	virt_qos_lock_ops.lock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	worker->log[strlen(worker->log)] = worker->name;
+	virt_qos_lock_ops.unlock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	complete(&worker->done);
+	return 0;
+}
+
+static struct qos_worker *qos_add_worker(struct kunit *test, char name,
+		char *log, unsigned int weight) {
+	struct qos_worker *worker;
+
+	worker = kunit_kzalloc(test, sizeof(struct qos_worker), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, worker);
+	worker->name = name;
+	worker->log = log;
+	init_completion(&worker->held);
+	init_completion(&worker->go);
+	init_completion(&worker->done);
+	worker->task = kthread_create(qos_worker_fn, worker, "qos-%c", name);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, worker->task);
+	// A kernel thread is a client of its own (tgid)
+	KUNIT_ASSERT_EQ(test, virt_qos_configure(task_tgid_nr(worker->task),
+			weight, 1), 0);
+	return worker;
+}
+
+/*
+ * Two clients that have used the bus for the same time wait for it.
+ * The client with twice the weight has been charged half the virtual
+ * time and is served first, although it started waiting last.
+ */
+static void virt_bus_test_qos(struct kunit *test) {
+	struct qos_worker *heavy;
+	struct qos_worker *light;
+	char *log;
+
+	log = kunit_kzalloc(test, 4, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, log);
+	heavy = qos_add_worker(test, 'H', log, 200);
+	light = qos_add_worker(test, 'L', log, 100);
+
+	// Use the bus one after the other
+	wake_up_process(heavy->task);
+	wait_for_completion(&heavy->held);
+	wake_up_process(light->task);
+	wait_for_completion(&light->held);
+
+	// Let both wait for the bus, the light worker first
+	virt_qos_lock_ops.lock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	complete(&light->go);
+	msleep(QOS_HOLD_MS);
+	complete(&heavy->go);
+	msleep(QOS_HOLD_MS);
+	virt_qos_lock_ops.unlock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	wait_for_completion(&light->done);
+	wait_for_completion(&heavy->done);
+
+	KUNIT_EXPECT_STREQ(test, log, "HL");
+}
+
+struct bench_param {
+	int slaves;
+	int size;
+};
+
+static const struct bench_param bench_params[] = {
+	{ 1, 1 }, { 1, 2 }, { 1, 16 }, { 1, 64 }, { 1, 256 },
+	{ 8, 2 }, { 32, 2 }, { 64, 2 }, { 64, 256 },
+};
+
+static void bench_param_desc(const struct bench_param *param, char *desc) {
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "%d slaves, %d bytes",
+			param->slaves, param->size);
+}
+
+KUNIT_ARRAY_PARAM(bench, bench_params, bench_param_desc);
+
+/**
+ * Reports the time per transfer and per byte.
+ */
+static void bench_report(struct kunit *test, const char *what,
+		u64 elapsed, int xfers, int size) {
+	u64 per_byte = div_u64(elapsed * 1000, (u64)xfers * size);
+	u32 frac;
+
+	per_byte = div_u64_rem(per_byte, 1000, &frac);
+	kunit_info(test, "%s: %llu ns/xfer, %llu.%03u ns/byte\n", what,
+			div_u64(elapsed, xfers), per_byte, frac);
+}
+
+/*
+ * Register reads (write register pointer, read data) with the
+ * slaves being addressed round robin.
+ */
+static void virt_bus_bench_read(struct kunit *test) {
+	const struct bench_param *param = test->param_value;
+	struct bench_ctx *ctx = test->priv;
+	u8 reg = 0;
+	u8 *in;
+	struct i2c_msg msgs[2];
+	int xfers = max(BENCH_BYTES / param->size, 256);
+	u64 start;
+	int i;
+	int ret;
+
+	in = kunit_kzalloc(test, param->size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, in);
+	bench_add_slaves(test, param->slaves);
+
+	msgs[0] = (struct i2c_msg) { .len = 1, .buf = &reg };
+	msgs[1] = (struct i2c_msg) {
+		.flags = I2C_M_RD, .len = param->size, .buf = in };
+	start = ktime_get_ns();
+	for (i = 0; i < xfers; i++) {
+		msgs[0].addr = msgs[1].addr
+				= ctx->slaves[i % ctx->nslaves]->addr;
+		ret = i2c_transfer(&virt_master_adapter, msgs, 2);
+		if (ret != 2) {
+			KUNIT_FAIL(test, "Transfer failed: %d", ret);
+			return;
+		}
+	}
+	bench_report(test, "read", ktime_get_ns() - start, xfers, param->size);
+}
+
+/*
+ * Register writes with the slaves being addressed round robin.
+ */
+static void virt_bus_bench_write(struct kunit *test) {
+	const struct bench_param *param = test->param_value;
+	struct bench_ctx *ctx = test->priv;
+	u8 *out;
+	struct i2c_msg msg;
+	int xfers = max(BENCH_BYTES / param->size, 256);
+	u64 start;
+	int i;
+	int ret;
+
+	out = kunit_kzalloc(test, param->size + 1, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, out);
+	bench_add_slaves(test, param->slaves);
+
+	msg = (struct i2c_msg) { .len = param->size + 1, .buf = out };
+	start = ktime_get_ns();
+	for (i = 0; i < xfers; i++) {
+		msg.addr = ctx->slaves[i % ctx->nslaves]->addr;
+		ret = i2c_transfer(&virt_master_adapter, &msg, 1);
+		if (ret != 1) {
+			KUNIT_FAIL(test, "Transfer failed: %d", ret);
+			return;
+		}
+	}
+	bench_report(test, "write", ktime_get_ns() - start, xfers,
+			param->size);
+}
+
+/*
+ * Temperature reads from DS1621 slaves (i2c_slave_ds1621_slave_cb).
+ * Skipped if the i2c-slave-ds1621 driver isn't loaded.
+ */
+static void virt_bus_bench_ds1621(struct kunit *test) {
+	const struct bench_param *param = test->param_value;
+	struct bench_ctx *ctx = test->priv;
+	struct i2c_client *client;
+	u8 cmd = 0xaa;
+	u8 in[2];
+	struct i2c_msg msgs[2];
+	u16 addr = 0x48;
+	int xfers = BENCH_BYTES / 2;
+	u64 start;
+	int i;
+	int ret;
+
+	if (param->size != 2) {
+		kunit_skip(test, "Temperature has 2 bytes");
+	}
+	while (ctx->nslaves < min(param->slaves, 8)) {
+		client = bench_add_slave(ctx->hub, "slave-ds1621", &addr, 0x4f,
+				NULL, NULL);
+		if (IS_ERR(client)) {
+			break;
+		}
+		ctx->slaves[ctx->nslaves++] = client;
+		if (!client->dev.driver) {
+			kunit_skip(test, "i2c-slave-ds1621 not loaded");
+		}
+	}
+	if (ctx->nslaves == 0) {
+		kunit_skip(test, "No DS1621 address available");
+	}
+
+	msgs[0] = (struct i2c_msg) { .len = 1, .buf = &cmd };
+	msgs[1] = (struct i2c_msg) { .flags = I2C_M_RD, .len = 2, .buf = in };
+	start = ktime_get_ns();
+	for (i = 0; i < xfers; i++) {
+		msgs[0].addr = msgs[1].addr
+				= ctx->slaves[i % ctx->nslaves]->addr;
+		ret = i2c_transfer(&virt_master_adapter, msgs, 2);
+		if (ret != 2) {
+			KUNIT_FAIL(test, "Transfer failed: %d", ret);
+			return;
+		}
+	}
+	bench_report(test, "ds1621", ktime_get_ns() - start, xfers, 2);
+}
+
+static struct kunit_case virt_bus_test_cases[] = {
+	KUNIT_CASE(virt_bus_test_xfer),
+	KUNIT_CASE(virt_bus_test_no_slave),
+	KUNIT_CASE(virt_bus_test_vcd),
+	KUNIT_CASE(virt_bus_test_qos),
+	KUNIT_CASE_PARAM(virt_bus_bench_read, bench_gen_params),
+	KUNIT_CASE_PARAM(virt_bus_bench_write, bench_gen_params),
+	KUNIT_CASE_PARAM(virt_bus_bench_ds1621, bench_gen_params),
+	{}
+};
+
+static struct kunit_suite virt_bus_test_suite = {
+	.name = "i2c-virt-bus",
+	.init = virt_bus_test_init,
+	.exit = virt_bus_test_exit,
+	.test_cases = virt_bus_test_cases,
+};
+
+kunit_test_suite(virt_bus_test_suite);
@@ -0,0 +1,322 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+    i2c-virt-deferred.c - Deferred processing by slow slaves
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+    Normally, the master invokes the slave callbacks while it holds
+    its bus lock and the hub lock, so a slow slave blocks all clients
+    of the master. A slave that is marked as deferred (with the hub's
+    sysfs file "deferred") processes the transfers addressed to it in
+    the work of its own ordered workqueue. The master holds the locks
+    only while it hands off the transfer and while it accounts for
+    the results (PEC, VCD) after the work has completed. Meanwhile,
+    other clients can access other slaves.
+
+    The master keeps its bus lock while the work runs if the bus is
+    scheduled by i2c-virt-qos, if the slave is attached to a channel
+    of a simulated multiplexer (the route must not change) or if the
+    transfer is part of the sequence of an i2c-mux multiplexer, i.e.
+    the master's mux lock is held.
+
+    Transfers to a deferred slave are serialized by its workqueue
+    and the messages of a transfer are passed to the slave without
+    interruption, as they would be on the bus. A transfer that
+    addresses several slaves is processed by the master as usual,
+    waiting for the work of a deferred slave to complete before
+    invoking its callback.
+*/
+
+#define DEBUG 1
+#define pr_fmt(fmt) "i2c-virt-deferred: " fmt
+
+#include <linux/delay.h>
+#include <linux/device.h>
+#include <linux/errno.h>
+#include <linux/i2c.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/rtmutex.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+#include <linux/workqueue.h>
+
+#include "i2c-virt-hub.h"
+
+/** Serializes the changes of the settings. */
+static DEFINE_MUTEX(deferred_store_lock);
+
+/**
+ * Returns the slave that the message is addressed to if it is
+ * deferred, else NULL. Multiplexers cannot be deferred, as the
+ * master needs their state to find slaves.
+ */
+static struct i2c_client *deferred_slave(struct virt_hub *hub,
+		struct i2c_msg *msg, struct virt_deferred **deferred) {
+	struct i2c_client *client;
+	struct virt_hub *owner;
+	struct virt_mux *mux;
+
+	client = (msg->flags & I2C_M_TEN) ? NULL
+			: virt_hub_find_slave(hub, msg->addr);
+	if (!client) {
+		return NULL;
+	}
+	owner = to_virt_hub(client->adapter);
+	*deferred = owner->deferred[client->addr];
+	if (!*deferred || (*deferred)->retired) {
+		return NULL;
+	}
+	list_for_each_entry(mux, &owner->muxes, node) {
+		if (mux->client == client) {
+			return NULL;
+		}
+	}
+	return client;
+}
+
+/**
+ * Checks if the transfer is to be handed off to a deferred slave
+ * and prepares the hand off. This is the case if all messages are
+ * addressed to the same deferred slave. If the transfer has a PEC
+ * and ends with a write, the PEC is checked now (the slave discards
+ * the last message if it doesn't match), which requires the data
+ * of all messages to be known, i.e. there must be no reads.
+ * Must be called with the hub locked.
+ */
+bool virt_deferred_prepare(struct virt_hub *hub, struct i2c_msg *msgs,
+		int num, bool pec, struct virt_deferred_xfer *xfer) {
+	struct virt_deferred *deferred;
+	struct i2c_client *client;
+	bool reads = false;
+	bool single = true;
+	u8 crc = 0;
+	u8 addr;
+	int i;
+
+	xfer->client = NULL;
+	for (i = 0; i < num; i++) {
+		reads |= !!(msgs[i].flags & I2C_M_RD);
+		single &= msgs[i].addr == msgs[0].addr
+				&& !((msgs[i].flags ^ msgs[0].flags) & I2C_M_TEN);
+	}
+	client = deferred_slave(hub, &msgs[0], &deferred);
+	if (!client || !single
+			|| (pec && !(msgs[num - 1].flags & I2C_M_RD) && reads)) {
+		return false;
+	}
+
+	xfer->wq = deferred->wq;
+	xfer->delay = deferred->delay;
+	xfer->client = client;
+	xfer->msgs = msgs;
+	xfer->count = num;
+	if (pec && !reads) {
+		for (i = 0; i < num; i++) {
+			addr = msgs[i].addr << 1;
+			crc = virt_pec_update(crc, &addr, 1);
+			crc = virt_pec_update(crc, msgs[i].buf, msgs[i].len);
+		}
+		xfer->pec_sent = virt_pec_transmit(client, crc);
+		if (xfer->pec_sent != crc) {
+			xfer->count = num - 1;
+		}
+	}
+	return true;
+}
+
+static void virt_deferred_work(struct work_struct *work) {
+	struct virt_deferred_xfer *xfer
+			= container_of(work, struct virt_deferred_xfer, work);
+	int i;
+
+	if (xfer->delay) {
+		fsleep(xfer->delay);
+	}
+	xfer->ret = 0;
+	for (i = 0; i < xfer->count; i++) {
+		xfer->ret = virt_master_xfer_msg(xfer->adap, xfer->client, i,
+				&xfer->msgs[i]);
+		if (xfer->ret < 0) {
+			break;
+		}
+	}
+	xfer->executed = i;
+	complete(&xfer->done);
+}
+
+/**
+ * Checks if the master's bus lock can be released while the work
+ * of the slave runs (see the description at the top).
+ */
+static bool master_unlockable(struct i2c_adapter *adap,
+		struct virt_hub *hub, struct i2c_client *client) {
+	return adap->lock_ops != &virt_qos_lock_ops
+			&& client->adapter == &hub->root->adap
+			&& !rt_mutex_is_locked(&adap->mux_lock);
+}
+
+/**
+ * Hands off the prepared transfer to the slave's work and waits
+ * for its completion. The hub lock and, if possible, the master's
+ * bus lock are released while waiting. Must be called with both
+ * locked.
+ */
+void virt_deferred_run(struct i2c_adapter *adap, struct virt_hub *hub,
+		struct virt_deferred_xfer *xfer) {
+	bool unlock = master_unlockable(adap, hub, xfer->client);
+
+	xfer->adap = adap;
+	init_completion(&xfer->done);
+	INIT_WORK_ONSTACK(&xfer->work, virt_deferred_work);
+	queue_work(xfer->wq, &xfer->work);
+
+	virt_hub_unlock(hub);
+	if (unlock) {
+		i2c_unlock_bus(adap, I2C_LOCK_SEGMENT);
+	}
+	wait_for_completion(&xfer->done);
+	if (unlock) {
+		i2c_lock_bus(adap, I2C_LOCK_SEGMENT);
+	}
+	virt_hub_lock(hub);
+	destroy_work_on_stack(&xfer->work);
+}
+
+/**
+ * Waits for the transfers handed off to the slave at the given
+ * address to complete. Used before the master invokes the slave's
+ * callback itself and when the slave is unregistered. Must be
+ * called with the hub locked.
+ */
+void virt_deferred_flush(struct virt_hub *hub, u16 addr) {
+	if (addr < VIRT_HUB_ADDRS && hub->deferred[addr]) {
+		flush_workqueue(hub->deferred[addr]->wq);
+	}
+}
+
+static void virt_deferred_destroy(struct virt_deferred *deferred) {
+	if (deferred) {
+		destroy_workqueue(deferred->wq);
+		kfree(deferred);
+	}
+}
+
+/**
+ * Frees the state of the deferred slaves of a hub that has been
+ * deleted.
+ */
+void virt_deferred_free(struct virt_hub *hub) {
+	int addr;
+
+	for (addr = 0; addr < VIRT_HUB_ADDRS; addr++) {
+		virt_deferred_destroy(hub->deferred[addr]);
+		hub->deferred[addr] = NULL;
+	}
+}
+
+/**
+ * Shows the addresses of the deferred slaves and their modeled
+ * processing time.
+ */
+static ssize_t deferred_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct i2c_adapter *adap = to_i2c_adapter(dev);
+	struct virt_hub *hub = to_virt_hub(adap);
+	ssize_t res = 0;
+	int addr;
+
+	i2c_lock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	for (addr = 0; addr < VIRT_HUB_ADDRS; addr++) {
+		if (hub->deferred[addr] && !hub->deferred[addr]->retired) {
+			res += sysfs_emit_at(buf, res, "0x%02x %u\n", addr,
+					hub->deferred[addr]->delay);
+		}
+	}
+	i2c_unlock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	return res;
+}
+
+/**
+ * Defers the slave with the given address ("<address> [<delay>]",
+ * the delay being the modeled processing time of a transfer in µs)
+ * or processes its transfers synchronously again ("<address> off").
+ * The setting applies to the address, i.e. also to slaves that are
+ * registered later.
+ */
+static ssize_t deferred_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct i2c_adapter *adap = to_i2c_adapter(dev);
+	struct virt_hub *hub = to_virt_hub(adap);
+	struct virt_deferred *deferred = NULL;
+	struct virt_deferred *unused = NULL;
+	struct virt_deferred *old;
+	unsigned int addr, delay = 0;
+	char arg[12];
+	int args;
+
+	args = sscanf(buf, "%i %11s", &addr, arg);
+	if (args < 1 || addr >= VIRT_HUB_ADDRS) {
+		return -EINVAL;
+	}
+	if (args < 2 || strcmp(arg, "off") != 0) {
+		if (args == 2 && kstrtouint(arg, 0, &delay)) {
+			return -EINVAL;
+		}
+		deferred = kzalloc(sizeof(struct virt_deferred), GFP_KERNEL);
+		if (!deferred) {
+			return -ENOMEM;
+		}
+		deferred->wq = alloc_ordered_workqueue("i2c-virt-%s-%02x", 0,
+				dev_name(dev), addr);
+		if (!deferred->wq) {
+			kfree(deferred);
+			return -ENOMEM;
+		}
+		deferred->delay = delay;
+	}
+
+	mutex_lock(&deferred_store_lock);
+	i2c_lock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	old = hub->deferred[addr];
+	if (old && deferred) {
+		// Keep the workqueue, only the delay changes
+		old->delay = delay;
+		unused = deferred;
+	} else if (old) {
+		// No more transfers are handed off, but the master flushes
+		// the workqueue before invoking the slave's callback itself
+		old->retired = true;
+		unused = old;
+	} else {
+		hub->deferred[addr] = deferred;
+	}
+	i2c_unlock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+
+	if (old && unused == old) {
+		// Transfers handed off by clients that have released the
+		// master's bus lock may still be pending. The workqueue is
+		// removed only after they have completed, so the slave's
+		// callback is never invoked concurrently.
+		flush_workqueue(old->wq);
+		i2c_lock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+		hub->deferred[addr] = NULL;
+		i2c_unlock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	}
+	mutex_unlock(&deferred_store_lock);
+	virt_deferred_destroy(unused);
+	return count;
+}
+
+static DEVICE_ATTR_RW(deferred);
+
+static struct attribute *virt_deferred_attrs[] = {
+	&dev_attr_deferred.attr,
+	NULL,
+};
+
+const struct attribute_group virt_deferred_group = {
+	.attrs = virt_deferred_attrs,
+};
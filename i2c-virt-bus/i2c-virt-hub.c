@@ -9,32 +9,47 @@
 #define DEBUG 1
 #define pr_fmt(fmt) "i2c-virt-hub: " fmt
 
+#include <linux/bitops.h>
 #include <linux/errno.h>
 #include <linux/i2c.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/rtmutex.h>
 #include <linux/slab.h>
-#include <linux/list.h>
-
-static int reg_slave(struct i2c_client *slave) {
-	struct i2c_adapter *adap = slave->adapter;
-//	struct i2c_driver* i2c_driver = to_i2c_driver(adap->dev.driver);
-
-	dev_dbg(&adap->dev, "Register slave %s\n", slave->name);
+#include <linux/string.h>
 
+#include "i2c-virt-hub.h"
 
-	// void *priv = i2c_get_adapdata(slave->adapter);
+static int reg_slave(struct i2c_client *slave) {
+	struct virt_hub *hub = to_virt_hub(slave->adapter);
 
-//	i2c_driver->clients
+	dev_dbg(&hub->adap.dev, "Register slave %s\n", slave->name);
 
+	// Only 7-bit addresses are looked up
+	if (slave->flags & I2C_CLIENT_TEN) {
+		return -EAFNOSUPPORT;
+	}
+	if (hub->slaves[slave->addr]) {
+		return -EBUSY;
+	}
+	hub->slaves[slave->addr] = slave;
+	virt_hub_update_routes(hub);
 	return 0;
 }
 
 static int unreg_slave(struct i2c_client *slave) {
-//	void *priv = i2c_get_adapdata(slave->adapter);
+	struct virt_hub *hub = to_virt_hub(slave->adapter);
+
+	dev_dbg(&hub->adap.dev, "Unregister slave %s\n", slave->name);
 
+	if (hub->slaves[slave->addr] == slave) {
+		hub->slaves[slave->addr] = NULL;
+		virt_hub_update_routes(hub);
+	}
+	// The slave's callback must not be invoked after returning
+	virt_deferred_flush(hub, slave->addr);
 	return 0;
 }
 
@@ -60,51 +75,186 @@ static const struct i2c_algorithm virt_hub_algorithm = {
 	.unreg_slave = unreg_slave,
 };
 
-static struct i2c_adapter virt_bus_adapter = {
-	.owner		= THIS_MODULE,
-	.class		= I2C_CLASS_HWMON,
-	.algo		= &virt_hub_algorithm,
-	.name		= "I2C virt hub driver",
+static const struct attribute_group *virt_hub_groups[] = {
+	&virt_pec_group,
+	&virt_deferred_group,
+	NULL,
+};
+
+static struct virt_hub virt_hub = {
+	.adap = {
+		.owner		= THIS_MODULE,
+		.class		= I2C_CLASS_HWMON,
+		.algo		= &virt_hub_algorithm,
+		.name		= "I2C virt hub driver",
+		.dev.groups	= virt_hub_groups,
+	},
+	.root = &virt_hub,
+	.muxes = LIST_HEAD_INIT(virt_hub.muxes),
 };
 
-static void virt_hub_free(void) {
-//	kfree(stub_chips);
+/*
+ * The hubs of multiplexer channels use the root hub's bus lock. This
+ * makes the root hub's bus lock protect the complete topology.
+ */
+static void virt_hub_child_lock_bus(struct i2c_adapter *adap,
+		unsigned int flags) {
+	i2c_lock_bus(&to_virt_hub(adap)->root->adap, flags);
 }
 
-int __init virt_hub_init(struct i2c_adapter** adap);
+static int virt_hub_child_trylock_bus(struct i2c_adapter *adap,
+		unsigned int flags) {
+	return i2c_trylock_bus(&to_virt_hub(adap)->root->adap, flags);
+}
 
-int __init virt_hub_init(struct i2c_adapter** adap) {
-	int ret;
+static void virt_hub_child_unlock_bus(struct i2c_adapter *adap,
+		unsigned int flags) {
+	i2c_unlock_bus(&to_virt_hub(adap)->root->adap, flags);
+}
 
-	pr_info("Initializing new I2C hub\n");
+static const struct i2c_lock_operations virt_hub_child_lock_ops = {
+	.lock_bus = virt_hub_child_lock_bus,
+	.trylock_bus = virt_hub_child_trylock_bus,
+	.unlock_bus = virt_hub_child_unlock_bus,
+};
+
+/**
+ * Returns the hub for the given adapter or NULL if the adapter
+ * isn't a hub.
+ */
+struct virt_hub *virt_hub_of(struct i2c_adapter *adap) {
+	if (adap->algo != &virt_hub_algorithm) {
+		return NULL;
+	}
+	return to_virt_hub(adap);
+}
+
+/**
+ * Creates and registers a hub for a channel of a multiplexer
+ * that is attached to the given parent hub.
+ */
+struct virt_hub *virt_hub_add_child(struct virt_hub *parent,
+		struct device *dev, const char *name) {
+	struct virt_hub *hub;
+	int ret;
 
-	/* Allocate memory for all chips at once */
-//	stub_chips = kcalloc(1, sizeof(struct stub_chip),
-//			     GFP_KERNEL);
-//	if (!stub_chips) {
-//		return -ENOMEM;
-//	}
+	hub = kzalloc(sizeof(struct virt_hub), GFP_KERNEL);
+	if (!hub) {
+		return ERR_PTR(-ENOMEM);
+	}
+	hub->root = parent->root;
+	INIT_LIST_HEAD(&hub->muxes);
+	hub->adap.owner = THIS_MODULE;
+	hub->adap.class = I2C_CLASS_HWMON;
+	hub->adap.algo = &virt_hub_algorithm;
+	hub->adap.lock_ops = &virt_hub_child_lock_ops;
+	hub->adap.dev.parent = dev;
+	hub->adap.dev.groups = virt_hub_groups;
+	strscpy(hub->adap.name, name, sizeof(hub->adap.name));
 
-	ret = i2c_add_adapter(&virt_bus_adapter);
+	ret = i2c_add_adapter(&hub->adap);
 	if (ret) {
-		goto fail_free;
+		kfree(hub);
+		return ERR_PTR(ret);
 	}
-	*adap = &virt_bus_adapter;
+	return hub;
+}
 
-	return 0;
+void virt_hub_del_child(struct virt_hub *hub) {
+	i2c_del_adapter(&hub->adap);
+	virt_deferred_free(hub);
+	kfree(hub);
+}
+
+void virt_hub_add_mux(struct virt_hub *hub, struct virt_mux *mux) {
+	i2c_lock_bus(&hub->adap, I2C_LOCK_ROOT_ADAPTER);
+	list_add_tail(&mux->node, &hub->muxes);
+	virt_hub_update_routes(hub);
+	i2c_unlock_bus(&hub->adap, I2C_LOCK_ROOT_ADAPTER);
+}
+
+void virt_hub_del_mux(struct virt_hub *hub, struct virt_mux *mux) {
+	i2c_lock_bus(&hub->adap, I2C_LOCK_ROOT_ADAPTER);
+	list_del(&mux->node);
+	virt_hub_update_routes(hub);
+	i2c_unlock_bus(&hub->adap, I2C_LOCK_ROOT_ADAPTER);
+}
+
+/**
+ * Locks the topology of slaves and multiplexers. Used by the master
+ * while it holds its own bus lock, hence the nesting level.
+ */
+void virt_hub_lock(struct virt_hub *hub) {
+	rt_mutex_lock_nested(&hub->root->adap.bus_lock, SINGLE_DEPTH_NESTING);
+}
+
+void virt_hub_unlock(struct virt_hub *hub) {
+	rt_mutex_unlock(&hub->root->adap.bus_lock);
+}
+
+static void virt_hub_add_routes(struct virt_hub *hub,
+		struct i2c_client **routes) {
+	struct virt_mux *mux;
+	unsigned long enabled;
+	int addr;
+	int chan;
+
+	for (addr = 0; addr < VIRT_HUB_ADDRS; addr++) {
+		if (!routes[addr]) {
+			routes[addr] = hub->slaves[addr];
+		}
+	}
+	list_for_each_entry(mux, &hub->muxes, node) {
+		enabled = mux->control;
+		for_each_set_bit(chan, &enabled, mux->nchans) {
+			virt_hub_add_routes(mux->chans[chan], routes);
+		}
+	}
+}
+
+/**
+ * Updates the slaves reachable from the root hub. Slaves attached
+ * directly to a hub take precedence, then the enabled channels of
+ * the multiplexers are searched in the order of registration and
+ * of the channel number. Must be called with the hub locked after
+ * the topology or the control register of a multiplexer has changed.
+ */
+void virt_hub_update_routes(struct virt_hub *hub) {
+	struct virt_hub *root = hub->root;
+
+	memset(root->routes, 0, sizeof(root->routes));
+	virt_hub_add_routes(root, root->routes);
+}
 
- fail_free:
-	virt_hub_free();
-	return ret;
+/**
+ * Find the slave with the given address that is reachable from
+ * the root hub. Must be called with the hub locked.
+ */
+struct i2c_client *virt_hub_find_slave(struct virt_hub *hub, u16 addr) {
+	if (addr >= VIRT_HUB_ADDRS) {
+		return NULL;
+	}
+	return hub->root->routes[addr];
 }
 
-void __exit virt_hub_exit(void);
+int __init virt_hub_init(struct virt_hub** hub) {
+	int ret;
+
+	pr_info("Initializing new I2C hub\n");
+
+	ret = i2c_add_adapter(&virt_hub.adap);
+	if (ret) {
+		return ret;
+	}
+	*hub = &virt_hub;
 
-void __exit virt_hub_exit(void)
+	return 0;
+}
+
+void virt_hub_exit(void)
 {
 	pr_info("Deleting I2C hub\n");
 
-	i2c_del_adapter(&virt_bus_adapter);
-	virt_hub_free();
+	i2c_del_adapter(&virt_hub.adap);
+	virt_deferred_free(&virt_hub);
 }
-
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+    i2c-virt-hub.h - Definitions shared by the parts of the virtual bus
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+*/
+
+#ifndef I2C_VIRT_HUB_H_
+#define I2C_VIRT_HUB_H_
+
+#include <linux/completion.h>
+#include <linux/i2c.h>
+#include <linux/list.h>
+#include <linux/workqueue.h>
+
+struct dentry;
+struct vcd_reader;
+
+/** Number of 7-bit addresses, i.e. the size of a hub's slave table. */
+#define VIRT_HUB_ADDRS 128
+
+/** Maximum number of channels of a simulated multiplexer. */
+#define VIRT_MUX_MAX_CHANS 8
+
+/**
+ * The state of a hub's address whose slave is deferred, i.e.
+ * processes the transfers addressed to it in its own work.
+ */
+struct virt_deferred {
+	/** Ordered, serializes the invocations of the slave callback. */
+	struct workqueue_struct *wq;
+	/** The modeled processing time of a transfer (µs). */
+	unsigned int delay;
+	/** Set while the workqueue is drained before it is removed. */
+	bool retired;
+};
+
+/**
+ * A hub, i.e. an adapter that slaves are registered with. Apart
+ * from the root hub created when the module is loaded, there is
+ * a hub for every channel of a simulated multiplexer.
+ */
+struct virt_hub {
+	struct i2c_adapter adap;
+	/** The root hub. Its bus lock protects all hubs. */
+	struct virt_hub *root;
+	/** The registered slaves, indexed by address. */
+	struct i2c_client *slaves[VIRT_HUB_ADDRS];
+	/**
+	 * Root hub only: the slaves reachable with the current settings
+	 * of the multiplexers, indexed by address.
+	 */
+	struct i2c_client *routes[VIRT_HUB_ADDRS];
+	/** The multiplexers registered as slaves with this hub. */
+	struct list_head muxes;
+	/** The number of PEC errors to inject, indexed by address. */
+	u8 pec_errors[VIRT_HUB_ADDRS];
+	/** The deferred slaves, indexed by address. */
+	struct virt_deferred *deferred[VIRT_HUB_ADDRS];
+};
+
+/**
+ * A simulated PCA954x multiplexer. The multiplexer is a slave of
+ * the hub that it is attached to and provides a (child) hub for
+ * each of its channels.
+ */
+struct virt_mux {
+	struct list_head node;
+	struct i2c_client *client;
+	/** The control register, bit n enables channel n. */
+	u8 control;
+	u8 nchans;
+	struct virt_hub *chans[VIRT_MUX_MAX_CHANS];
+};
+
+/**
+ * A transfer handed off to a deferred slave. Lives on the stack of
+ * the master's caller, which waits for the transfer's completion.
+ */
+struct virt_deferred_xfer {
+	struct work_struct work;
+	struct completion done;
+	struct workqueue_struct *wq;
+	struct i2c_adapter *adap;
+	/** The slave, NULL if the transfer isn't deferred. */
+	struct i2c_client *client;
+	struct i2c_msg *msgs;
+	/** The number of messages to pass to the slave. */
+	int count;
+	unsigned int delay;
+	/** The number of messages passed successfully. */
+	int executed;
+	/** The result of the message that failed. */
+	int ret;
+	/** The PEC received by the slave if the transfer ends with a write. */
+	u8 pec_sent;
+};
+
+#define to_virt_hub(a) container_of(a, struct virt_hub, adap)
+
+/** The master, used to access the slaves attached to the hub. */
+extern struct i2c_adapter virt_master_adapter;
+
+int virt_master_transfer(struct i2c_adapter *adap, struct i2c_msg* msgs,
+		int num, bool pec);
+int virt_master_xfer_msg(struct i2c_adapter *adap, struct i2c_client *client,
+		int idx, struct i2c_msg* msg);
+
+int virt_hub_init(struct virt_hub **hub);
+void virt_hub_exit(void);
+
+struct virt_hub *virt_hub_of(struct i2c_adapter *adap);
+struct virt_hub *virt_hub_add_child(struct virt_hub *parent,
+		struct device *dev, const char *name);
+void virt_hub_del_child(struct virt_hub *hub);
+void virt_hub_add_mux(struct virt_hub *hub, struct virt_mux *mux);
+void virt_hub_del_mux(struct virt_hub *hub, struct virt_mux *mux);
+
+void virt_hub_lock(struct virt_hub *hub);
+void virt_hub_unlock(struct virt_hub *hub);
+void virt_hub_update_routes(struct virt_hub *hub);
+struct i2c_client *virt_hub_find_slave(struct virt_hub *hub, u16 addr);
+
+int virt_mux_init(void);
+void virt_mux_exit(void);
+
+void virt_batch_init(struct dentry *dir);
+
+/** The scheduler's lock operations, installed if enabled. */
+extern const struct i2c_lock_operations virt_qos_lock_ops;
+
+int virt_qos_init(struct i2c_adapter *adap);
+void virt_qos_exit(void);
+int virt_qos_configure(u64 id, unsigned int weight, unsigned int class);
+
+int virt_vcd_init(struct dentry *dir);
+void virt_vcd_exit(void);
+bool virt_vcd_active(void);
+void virt_vcd_start(bool repeated);
+void virt_vcd_bytes(const u8 *buf, size_t len, bool nack_last);
+void virt_vcd_stop(void);
+struct vcd_reader *virt_vcd_begin(void);
+void virt_vcd_end(struct vcd_reader *reader);
+size_t virt_vcd_text(struct vcd_reader *reader, char *buf, size_t count);
+
+/** The attributes of a hub for injecting PEC errors. */
+extern const struct attribute_group virt_pec_group;
+
+void virt_pec_init(void);
+u8 virt_pec_update(u8 crc, const u8 *buf, size_t len);
+u8 virt_pec_transmit(struct i2c_client *client, u8 pec);
+int virt_pec_smbus_xfer(struct i2c_adapter *adap, u16 addr,
+		unsigned short flags, char read_write, u8 command, int size,
+		union i2c_smbus_data *data);
+
+/** The attribute of a hub for deferring slaves. */
+extern const struct attribute_group virt_deferred_group;
+
+bool virt_deferred_prepare(struct virt_hub *hub, struct i2c_msg *msgs,
+		int num, bool pec, struct virt_deferred_xfer *xfer);
+void virt_deferred_run(struct i2c_adapter *adap, struct virt_hub *hub,
+		struct virt_deferred_xfer *xfer);
+void virt_deferred_flush(struct virt_hub *hub, u16 addr);
+void virt_deferred_free(struct virt_hub *hub);
+
+#endif /* I2C_VIRT_HUB_H_ */
@@ -9,6 +9,7 @@
 #define DEBUG 1
 #define pr_fmt(fmt) "i2c-virt-master: " fmt
 
+#include <linux/debugfs.h>
 #include <linux/errno.h>
 #include <linux/i2c.h>
 #include <linux/init.h>
@@ -18,10 +19,14 @@
 #include <linux/slab.h>
 #include <linux/list.h>
 
+#include "i2c-virt-hub.h"
+
 /*
- * Handle single transfer. Return negative errno on error.
+ * Handle single transfer. Return negative errno on error. Also used
+ * by the work of deferred slaves, without the hub locked (and usually
+ * without the bus locked).
  */
-static int i2c_xfer(struct i2c_adapter *adap, struct i2c_client *client,
+int virt_master_xfer_msg(struct i2c_adapter *adap, struct i2c_client *client,
 		int idx, struct i2c_msg* msg) {
 	u8 value;
 	int i;
@@ -34,6 +39,14 @@ static int i2c_xfer(struct i2c_adapter *adap, struct i2c_client *client,
 		// Read data
 		i2c_slave_event(client, I2C_SLAVE_READ_REQUESTED, &value);
 		msg->buf[0] = value;
+		if (msg->flags & I2C_M_RECV_LEN) {
+			// First byte is the number of bytes that follow
+			if (value == 0 || value > I2C_SMBUS_BLOCK_MAX) {
+				i2c_slave_event(client, I2C_SLAVE_STOP, &value);
+				return -EPROTO;
+			}
+			msg->len += value;
+		}
 		for (i = 1; i < msg->len; i++) {
 			i2c_slave_event(client, I2C_SLAVE_READ_PROCESSED, &value);
 			msg->buf[i] = value;
@@ -52,80 +65,180 @@ static int i2c_xfer(struct i2c_adapter *adap, struct i2c_client *client,
 }
 
 /*
- * Handle transfers one by one. Return negative errno on error.
+ * Handle transfers one by one. If pec is set, the transfer is
+ * (the emulation of) an SMBus command with PEC. Return negative
+ * errno on error.
  */
-static int virt_master_xfer(
-		struct i2c_adapter *adap, struct i2c_msg* msgs, int num) {
-	struct i2c_adapter* hub = i2c_get_adapdata(adap);
+int virt_master_transfer(struct i2c_adapter *adap, struct i2c_msg* msgs,
+		int num, bool pec) {
+	struct virt_hub* hub = i2c_get_adapdata(adap);
+	struct virt_deferred_xfer deferred;
+	struct i2c_client *client;
+	bool vcd;
+	bool pec_follows;
+	u8 crc = 0;
+	u8 sent;
+	u8 addr;
 	int i;
-	struct i2c_client *client = NULL;
-	int found = FALSE;
 	int ret;
 
 	dev_dbg(&adap->dev, "I2C virt bus xfer %d messages:\n", num);
 
+	virt_hub_lock(hub);
+	if (virt_deferred_prepare(hub, msgs, num, pec, &deferred)) {
+		// The slave processes the messages without the locks held,
+		// the loop below only accounts for the results
+		virt_deferred_run(adap, hub, &deferred);
+	}
+	vcd = virt_vcd_active();
+
 	// Process all messages
 	for (i = 0; i < num; i++) {
-		// No or different client?
-		if (!client || client->addr != msgs[i].addr) {
-			// Find registered client
-			list_for_each_entry(client , &hub->userspace_clients, detected) {
-				if (msgs[i].addr == client->addr) {
-					found = TRUE;
-					break;
-				}
+		// Find registered client (multiplexer settings may have changed)
+		client = (msgs[i].flags & I2C_M_TEN) ? NULL
+				: virt_hub_find_slave(hub, msgs[i].addr);
+		// A deferred slave may have been removed in the meantime
+		if (deferred.client && client != deferred.client) {
+			client = NULL;
+		}
+		addr = msgs[i].addr << 1 | !!(msgs[i].flags & I2C_M_RD);
+		if (vcd) {
+			virt_vcd_start(i > 0);
+			virt_vcd_bytes(&addr, 1, !client);
+		}
+		if (!client) {
+			ret = -ENODEV;
+			goto unlock;
+		}
+		pec_follows = pec && i == num - 1;
+		if (pec) {
+			crc = virt_pec_update(crc, &addr, 1);
+		}
+
+		if (!(msgs[i].flags & I2C_M_RD)) {
+			if (vcd) {
+				virt_vcd_bytes(msgs[i].buf, msgs[i].len, false);
+			}
+			if (pec) {
+				crc = virt_pec_update(crc, msgs[i].buf, msgs[i].len);
 			}
-			if (!found) {
-				return -ENODEV;
+			// The slave checks the PEC following the last message
+			// and discards the command if it doesn't match. As the
+			// simulated slaves process the data immediately, the
+			// message isn't passed to the slave in this case.
+			if (pec_follows) {
+				sent = deferred.client ? deferred.pec_sent
+						: virt_pec_transmit(client, crc);
+				if (vcd) {
+					virt_vcd_bytes(&sent, 1, sent != crc);
+				}
+				if (sent != crc) {
+					dev_dbg(&adap->dev, "  PEC mismatch, NACKed\n");
+					ret = -EIO;
+					goto unlock;
+				}
 			}
 		}
 
 		// Transfer current message
-		ret = i2c_xfer(adap, client, i, &msgs[i]);
+		if (deferred.client) {
+			ret = i < deferred.executed ? 0 : deferred.ret;
+		} else {
+			// Transfers handed off by others must have completed
+			virt_deferred_flush(to_virt_hub(client->adapter),
+					client->addr);
+			ret = virt_master_xfer_msg(adap, client, i, &msgs[i]);
+		}
 		if (ret < 0) {
-			return ret;
+			goto unlock;
+		}
+
+		if (msgs[i].flags & I2C_M_RD) {
+			// The master NACKs the last byte (the PEC if it follows)
+			if (vcd) {
+				virt_vcd_bytes(msgs[i].buf, msgs[i].len, !pec_follows);
+			}
+			if (pec) {
+				crc = virt_pec_update(crc, msgs[i].buf, msgs[i].len);
+			}
+			// The slave sends the PEC following the last message
+			if (pec_follows) {
+				sent = virt_pec_transmit(client, crc);
+				if (vcd) {
+					virt_vcd_bytes(&sent, 1, true);
+				}
+				if (sent != crc) {
+					dev_dbg(&adap->dev, "  PEC mismatch\n");
+					ret = -EBADMSG;
+					goto unlock;
+				}
+			}
 		}
 	}
-	return num;
+	ret = num;
+
+ unlock:
+	if (vcd) {
+		virt_vcd_stop();
+	}
+	virt_hub_unlock(hub);
+	return ret;
+}
+
+static int virt_master_xfer(
+		struct i2c_adapter *adap, struct i2c_msg* msgs, int num) {
+	return virt_master_transfer(adap, msgs, num, false);
 }
 
 /**
  * This implements a I2C controller, the emulation layer
- * converts SMBus commands into I2C transfers.
+ * converts SMBus commands into I2C transfers. As I2C_M_RECV_LEN
+ * is supported, this includes the SMBus block reads. SMBus
+ * commands with PEC are handled natively.
  */
 static u32 virt_master_func(struct i2c_adapter *adapter)
 {
-	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL
+			| I2C_FUNC_SMBUS_READ_BLOCK_DATA
+			| I2C_FUNC_SMBUS_BLOCK_PROC_CALL
+			| I2C_FUNC_SMBUS_PEC;
 }
 
 static const struct i2c_algorithm virt_master_algorithm = {
 	.functionality	= virt_master_func,
 	.master_xfer = virt_master_xfer,
+	.smbus_xfer = virt_pec_smbus_xfer,
 };
 
-static struct i2c_adapter virt_master_adapter = {
+struct i2c_adapter virt_master_adapter = {
 	.owner		= THIS_MODULE,
 	.class		= I2C_CLASS_HWMON,
 	.algo		= &virt_master_algorithm,
 	.name		= "I2C virt master driver",
 };
 
+static struct dentry *virt_bus_debugfs;
+
 static void virt_bus_free(void) {
 //	kfree(stub_chips);
 }
 
-extern int virt_hub_init(struct i2c_adapter**);
-
 static int __init virt_bus_init(void) {
 	int ret;
-	struct i2c_adapter* hub;
+	struct virt_hub* hub;
 
 	pr_info("Initializing new I2C bus\n");
 
+	virt_pec_init();
 	ret = virt_hub_init(&hub);
 	if (ret) {
 		return ret;
 	}
+	ret = virt_mux_init();
+	if (ret) {
+		virt_hub_exit();
+		return ret;
+	}
 
 	/* Allocate memory for all chips at once */
 //	stub_chips = kcalloc(1, sizeof(struct stub_chip),
@@ -134,28 +247,49 @@ static int __init virt_bus_init(void) {
 //		return -ENOMEM;
 //	}
 	i2c_set_adapdata(&virt_master_adapter, hub);
+	ret = virt_qos_init(&virt_master_adapter);
+	if (ret) {
+		goto fail_free;
+	}
 
 	ret = i2c_add_adapter(&virt_master_adapter);
 	if (ret) {
-		goto fail_free;
+		goto fail_qos;
+	}
+
+	// Debugging and testing facilities
+	virt_bus_debugfs = debugfs_create_dir("i2c-virt-bus", NULL);
+	virt_batch_init(virt_bus_debugfs);
+	ret = virt_vcd_init(virt_bus_debugfs);
+	if (ret) {
+		goto fail_debugfs;
 	}
 
 	return 0;
 
+ fail_debugfs:
+	debugfs_remove_recursive(virt_bus_debugfs);
+	i2c_del_adapter(&virt_master_adapter);
+ fail_qos:
+	virt_qos_exit();
  fail_free:
 	virt_bus_free();
+	virt_mux_exit();
+	virt_hub_exit();
 	return ret;
 }
 
-extern void virt_hub_exit(void);
-
 static void __exit virt_bus_exit(void)
 {
 	pr_info("Deleting I2C bus\n");
 
+	debugfs_remove_recursive(virt_bus_debugfs);
+	virt_vcd_exit();
 	i2c_del_adapter(&virt_master_adapter);
+	virt_qos_exit();
 	virt_bus_free();
 
+	virt_mux_exit();
 	virt_hub_exit();
 }
 
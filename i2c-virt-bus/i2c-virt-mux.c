@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+    i2c-virt-mux.c - A simulated PCA954x multiplexer for the hub
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+*/
+
+#define DEBUG 1
+#define pr_fmt(fmt) "i2c-virt-mux: " fmt
+
+#include <linux/errno.h>
+#include <linux/i2c.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+
+#include "i2c-virt-hub.h"
+
+/**
+ * Slave callback routine. The PCA9548/PCA9546 has a single control
+ * register that is written and read without a command byte.
+ */
+static int virt_mux_slave_cb(struct i2c_client *client,
+		enum i2c_slave_event event, u8 *val) {
+	struct virt_mux *mux = i2c_get_clientdata(client);
+
+	switch (event) {
+	case I2C_SLAVE_WRITE_RECEIVED:
+		mux->control = *val & GENMASK(mux->nchans - 1, 0);
+		dev_dbg(&client->dev, "Control %02x\n", mux->control);
+		// Invoked by the master, i.e. with the hub locked
+		virt_hub_update_routes(to_virt_hub(client->adapter));
+		break;
+
+	case I2C_SLAVE_READ_REQUESTED:
+	case I2C_SLAVE_READ_PROCESSED:
+		*val = mux->control;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static void virt_mux_del_chans(struct virt_mux *mux) {
+	char link[16];
+	int chan;
+
+	for (chan = mux->nchans - 1; chan >= 0; chan--) {
+		if (!mux->chans[chan]) {
+			continue;
+		}
+		snprintf(link, sizeof(link), "channel-%d", chan);
+		sysfs_remove_link(&mux->client->dev.kobj, link);
+		virt_hub_del_child(mux->chans[chan]);
+		mux->chans[chan] = NULL;
+	}
+}
+
+/**
+ * Registers a new multiplexer if it is attached to a hub and the
+ * given address is valid. Creates a hub for each channel, linked
+ * as "channel-<n>" from the multiplexer's sysfs directory (like
+ * the links created by the kernel's i2c-mux framework).
+ */
+static int virt_mux_probe(struct i2c_client *client) {
+	const struct i2c_device_id *id = i2c_client_get_device_id(client);
+	struct virt_hub *hub = virt_hub_of(client->adapter);
+	struct virt_hub *chan_hub;
+	struct virt_mux *mux;
+	char name[48];
+	char link[16];
+	int chan;
+	int ret;
+
+	// Must be attached to a hub
+	if (!hub) {
+		return -ENODEV;
+	}
+
+	// Check address, must be in range
+	if ((client->addr >> 3) != 0xe) {
+		return -ENXIO;
+	}
+
+	mux = devm_kzalloc(&client->dev, sizeof(struct virt_mux), GFP_KERNEL);
+	if (!mux) {
+		return -ENOMEM;
+	}
+	mux->client = client;
+	mux->nchans = id->driver_data;
+	i2c_set_clientdata(client, mux);
+
+	for (chan = 0; chan < mux->nchans; chan++) {
+		snprintf(name, sizeof(name), "I2C virt hub %s channel %d",
+				dev_name(&client->dev), chan);
+		chan_hub = virt_hub_add_child(hub, &client->dev, name);
+		if (IS_ERR(chan_hub)) {
+			ret = PTR_ERR(chan_hub);
+			goto fail_chans;
+		}
+		mux->chans[chan] = chan_hub;
+		snprintf(link, sizeof(link), "channel-%d", chan);
+		ret = sysfs_create_link(&client->dev.kobj,
+				&chan_hub->adap.dev.kobj, link);
+		if (ret) {
+			goto fail_chans;
+		}
+	}
+
+	// Register as slave
+	ret = i2c_slave_register(client, virt_mux_slave_cb);
+	if (ret) {
+		goto fail_chans;
+	}
+	virt_hub_add_mux(hub, mux);
+
+	return 0;
+
+ fail_chans:
+	virt_mux_del_chans(mux);
+	return ret;
+}
+
+static void virt_mux_remove(struct i2c_client *client) {
+	struct virt_mux *mux = i2c_get_clientdata(client);
+
+	virt_hub_del_mux(to_virt_hub(client->adapter), mux);
+	i2c_slave_unregister(client);
+	virt_mux_del_chans(mux);
+}
+
+static const struct i2c_device_id virt_mux_id[] = {
+	{ "slave-pca9548", 8 },
+	{ "slave-pca9546", 4 },
+	{ }
+};
+MODULE_DEVICE_TABLE(i2c, virt_mux_id);
+
+static struct i2c_driver virt_mux_driver = {
+	.driver = {
+		.name = "i2c-virt-mux",
+	},
+	.probe = virt_mux_probe,
+	.remove = virt_mux_remove,
+	.id_table = virt_mux_id,
+};
+
+int __init virt_mux_init(void) {
+	return i2c_add_driver(&virt_mux_driver);
+}
+
+void virt_mux_exit(void) {
+	i2c_del_driver(&virt_mux_driver);
+}
@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+    i2c-virt-pec.c - SMBus packet error checking for the virtual master
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+    The emulation of SMBus commands by i2c-core appends the PEC to
+    the messages, which the simulated slaves don't know about. So
+    the master handles SMBus commands with PEC natively: it passes
+    the messages without PEC to the slaves and computes the PEC
+    that would be sent over the bus. SMBus commands without PEC
+    are left to the emulation by i2c-core.
+*/
+
+#define DEBUG 1
+#define pr_fmt(fmt) "i2c-virt-pec: " fmt
+
+#include <linux/device.h>
+#include <linux/errno.h>
+#include <linux/i2c.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+
+#include "i2c-virt-hub.h"
+
+/** CRC-8 polynomial x^8 + x^2 + x + 1 as used by SMBus */
+#define PEC_POLY 0x07
+
+static u8 pec_table[256];
+
+void __init virt_pec_init(void) {
+	unsigned int i, bit;
+	u8 crc;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ PEC_POLY : crc << 1;
+		}
+		pec_table[i] = crc;
+	}
+}
+
+/**
+ * Updates the PEC with the given bytes.
+ */
+u8 virt_pec_update(u8 crc, const u8 *buf, size_t len) {
+	while (len--) {
+		crc = pec_table[crc ^ *buf++];
+	}
+	return crc;
+}
+
+/**
+ * Returns the PEC as received by the other side when the PEC of
+ * a transfer with the given client is sent. The PEC is corrupted
+ * if errors are to be injected for the client. Must be called
+ * with the hub locked.
+ */
+u8 virt_pec_transmit(struct i2c_client *client, u8 pec) {
+	struct virt_hub *hub = to_virt_hub(client->adapter);
+
+	if (hub->pec_errors[client->addr] == 0) {
+		return pec;
+	}
+	hub->pec_errors[client->addr] -= 1;
+	dev_dbg(&client->dev, "Injecting PEC error\n");
+	return ~pec;
+}
+
+/**
+ * Handles SMBus commands with PEC. The messages are the same
+ * as those created by the emulation in i2c-core (apart from
+ * the PEC).
+ */
+int virt_pec_smbus_xfer(struct i2c_adapter *adap, u16 addr,
+		unsigned short flags, char read_write, u8 command, int size,
+		union i2c_smbus_data *data) {
+	u8 out[I2C_SMBUS_BLOCK_MAX + 3];
+	u8 in[I2C_SMBUS_BLOCK_MAX + 1];
+	struct i2c_msg msgs[2] = {
+		{ .addr = addr, .flags = flags & I2C_M_TEN, .len = 1, .buf = out },
+		{ .addr = addr, .flags = (flags & I2C_M_TEN) | I2C_M_RD,
+				.len = 0, .buf = in },
+	};
+	int num = read_write == I2C_SMBUS_READ ? 2 : 1;
+	int ret;
+
+	if (!(flags & I2C_CLIENT_PEC)) {
+		return -EOPNOTSUPP;
+	}
+
+	out[0] = command;
+	switch (size) {
+	case I2C_SMBUS_BYTE:
+		if (read_write == I2C_SMBUS_READ) {
+			// Read byte without command
+			msgs[0] = msgs[1];
+			msgs[0].len = 1;
+			num = 1;
+		}
+		break;
+
+	case I2C_SMBUS_BYTE_DATA:
+		if (read_write == I2C_SMBUS_READ) {
+			msgs[1].len = 1;
+		} else {
+			msgs[0].len = 2;
+			out[1] = data->byte;
+		}
+		break;
+
+	case I2C_SMBUS_WORD_DATA:
+		if (read_write == I2C_SMBUS_READ) {
+			msgs[1].len = 2;
+		} else {
+			msgs[0].len = 3;
+			out[1] = data->word & 0xff;
+			out[2] = data->word >> 8;
+		}
+		break;
+
+	case I2C_SMBUS_PROC_CALL:
+		num = 2;
+		read_write = I2C_SMBUS_READ;
+		msgs[0].len = 3;
+		out[1] = data->word & 0xff;
+		out[2] = data->word >> 8;
+		msgs[1].len = 2;
+		break;
+
+	case I2C_SMBUS_BLOCK_DATA:
+		if (read_write == I2C_SMBUS_READ) {
+			msgs[1].flags |= I2C_M_RECV_LEN;
+			msgs[1].len = 1;
+			in[0] = 1;
+		} else {
+			if (data->block[0] == 0 || data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+				return -EINVAL;
+			}
+			msgs[0].len = data->block[0] + 2;
+			memcpy(out + 1, data->block, msgs[0].len - 1);
+		}
+		break;
+
+	case I2C_SMBUS_BLOCK_PROC_CALL:
+		if (data->block[0] == 0 || data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+			return -EINVAL;
+		}
+		num = 2;
+		read_write = I2C_SMBUS_READ;
+		msgs[0].len = data->block[0] + 2;
+		memcpy(out + 1, data->block, msgs[0].len - 1);
+		msgs[1].flags |= I2C_M_RECV_LEN;
+		msgs[1].len = 1;
+		in[0] = 1;
+		break;
+
+	default:
+		// Commands without PEC
+		return -EOPNOTSUPP;
+	}
+
+	ret = virt_master_transfer(adap, msgs, num, true);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (read_write == I2C_SMBUS_READ) {
+		switch (size) {
+		case I2C_SMBUS_BYTE:
+		case I2C_SMBUS_BYTE_DATA:
+			data->byte = in[0];
+			break;
+
+		case I2C_SMBUS_WORD_DATA:
+		case I2C_SMBUS_PROC_CALL:
+			data->word = in[0] | (in[1] << 8);
+			break;
+
+		case I2C_SMBUS_BLOCK_DATA:
+		case I2C_SMBUS_BLOCK_PROC_CALL:
+			memcpy(data->block, in, in[0] + 1);
+			break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Shows the addresses with pending PEC errors and the number of
+ * errors.
+ */
+static ssize_t pec_inject_show(struct device *dev,
+		struct device_attribute *attr, char *buf) {
+	struct i2c_adapter *adap = to_i2c_adapter(dev);
+	struct virt_hub *hub = to_virt_hub(adap);
+	ssize_t res = 0;
+	int addr;
+
+	i2c_lock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	for (addr = 0; addr < VIRT_HUB_ADDRS; addr++) {
+		if (hub->pec_errors[addr]) {
+			res += sysfs_emit_at(buf, res, "0x%02x %u\n", addr,
+					hub->pec_errors[addr]);
+		}
+	}
+	i2c_unlock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	return res;
+}
+
+/**
+ * Sets the number of PEC errors to inject for transfers with the
+ * slave with the given address ("<address> <count>").
+ */
+static ssize_t pec_inject_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count) {
+	struct i2c_adapter *adap = to_i2c_adapter(dev);
+	struct virt_hub *hub = to_virt_hub(adap);
+	unsigned int addr, errors;
+
+	if (sscanf(buf, "%i %u", &addr, &errors) != 2
+			|| addr >= VIRT_HUB_ADDRS || errors > U8_MAX) {
+		return -EINVAL;
+	}
+	i2c_lock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	hub->pec_errors[addr] = errors;
+	i2c_unlock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	return count;
+}
+
+static DEVICE_ATTR_RW(pec_inject);
+
+static struct attribute *virt_pec_attrs[] = {
+	&dev_attr_pec_inject.attr,
+	NULL,
+};
+
+const struct attribute_group virt_pec_group = {
+	.attrs = virt_pec_attrs,
+};
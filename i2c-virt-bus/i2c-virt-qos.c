@@ -0,0 +1,425 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+    i2c-virt-qos.c - Fair-share scheduling of the master's clients
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+    If enabled with the module parameter "qos", the master's bus lock
+    is replaced by a scheduler. The processes (or cgroups, see module
+    parameter "qos_key") waiting for the bus are granted access
+    according to their priority class and, within a class, by
+    start-time fair queuing: each client has a virtual time that
+    advances by the time it has held the bus divided by its weight,
+    and the waiting client with the smallest virtual time is served
+    first.
+
+    Weights and classes are set with the master's sysfs file "qos",
+    which also shows the latency statistics of the clients.
+*/
+
+#define DEBUG 1
+#define pr_fmt(fmt) "i2c-virt-qos: " fmt
+
+#include <linux/cgroup.h>
+#include <linux/completion.h>
+#include <linux/device.h>
+#include <linux/errno.h>
+#include <linux/hashtable.h>
+#include <linux/i2c.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+
+#include "i2c-virt-hub.h"
+
+static bool qos;
+module_param(qos, bool, 0444);
+MODULE_PARM_DESC(qos, "Schedule the clients of the master by weight and class");
+
+static char *qos_key = "tgid";
+module_param(qos_key, charp, 0444);
+MODULE_PARM_DESC(qos_key, "What identifies a client (\"tgid\" or \"cgroup\")");
+
+/** The priority classes, lower classes are always served first. */
+#define QOS_CLASSES 3
+#define QOS_DEFAULT_CLASS 1
+#define QOS_DEFAULT_WEIGHT 100
+#define QOS_MAX_WEIGHT 10000
+
+/** Clients that exceed this number share the default client. */
+#define QOS_MAX_CLIENTS 1024
+
+/**
+ * A client of the master (a process or a cgroup).
+ */
+struct qos_client {
+	struct hlist_node node;
+	u64 id;
+	unsigned int weight;
+	unsigned int class;
+	/** Set if weight and class have been configured. */
+	bool configured;
+	/** The virtual time of the client. */
+	u64 vtime;
+	/** Statistics (ns) */
+	u64 count;
+	u64 wait_total;
+	u64 wait_max;
+	u64 hold_total;
+};
+
+/**
+ * A task waiting for the bus.
+ */
+struct qos_waiter {
+	struct list_head node;
+	struct qos_client *client;
+	u64 enqueued;
+	struct completion granted;
+};
+
+static struct {
+	spinlock_t lock;
+	DECLARE_HASHTABLE(clients, 8);
+	unsigned int nclients;
+	/** Used for unknown clients and if there are too many clients. */
+	struct qos_client fallback;
+	/** The waiting tasks, in order of arrival. */
+	struct list_head waiting;
+	/** The client holding the bus or NULL. */
+	struct qos_client *owner;
+	u64 hold_start;
+	/** The virtual time of the client served last. */
+	u64 vclock;
+	bool by_cgroup;
+} qos_state;
+
+static u64 qos_current_id(void) {
+#ifdef CONFIG_CGROUPS
+	u64 id;
+
+	if (qos_state.by_cgroup) {
+		rcu_read_lock();
+		id = cgroup_id(task_dfl_cgroup(current));
+		rcu_read_unlock();
+		return id;
+	}
+#endif
+	return task_tgid_nr(current);
+}
+
+static struct qos_client *qos_find(u64 id) {
+	struct qos_client *client;
+
+	hash_for_each_possible(qos_state.clients, client, node, id) {
+		if (client->id == id) {
+			return client;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Returns the client with the given id, adding the prepared client
+ * if there is none yet. Must be called with the lock held.
+ */
+static struct qos_client *qos_lookup(u64 id, struct qos_client **prepared) {
+	struct qos_client *client = qos_find(id);
+
+	if (client) {
+		return client;
+	}
+	if (!*prepared || qos_state.nclients >= QOS_MAX_CLIENTS) {
+		return &qos_state.fallback;
+	}
+	client = *prepared;
+	*prepared = NULL;
+	client->id = id;
+	client->weight = qos_state.fallback.weight;
+	client->class = qos_state.fallback.class;
+	hash_add(qos_state.clients, &client->node, id);
+	qos_state.nclients += 1;
+	return client;
+}
+
+/**
+ * Grants the bus to the client. Must be called with the lock held.
+ */
+static void qos_grant(struct qos_client *client, u64 enqueued) {
+	u64 now = ktime_get_ns();
+	u64 wait = now - enqueued;
+
+	qos_state.owner = client;
+	qos_state.hold_start = now;
+	qos_state.vclock = client->vtime;
+	client->count += 1;
+	client->wait_total += wait;
+	if (wait > client->wait_max) {
+		client->wait_max = wait;
+	}
+}
+
+/**
+ * Selects the next waiter: the first waiter of the client with
+ * the smallest virtual time in the highest class.
+ */
+static struct qos_waiter *qos_select(void) {
+	struct qos_waiter *waiter;
+	struct qos_waiter *best = NULL;
+
+	list_for_each_entry(waiter, &qos_state.waiting, node) {
+		if (!best || waiter->client->class < best->client->class
+				|| (waiter->client->class == best->client->class
+					&& waiter->client->vtime < best->client->vtime)) {
+			best = waiter;
+		}
+	}
+	return best;
+}
+
+static void virt_qos_lock_bus(struct i2c_adapter *adap, unsigned int flags) {
+	struct qos_client *prepared = NULL;
+	struct qos_waiter waiter;
+	u64 id = qos_current_id();
+
+	spin_lock(&qos_state.lock);
+	waiter.client = qos_find(id);
+	if (!waiter.client) {
+		// New client, allocate outside the lock
+		spin_unlock(&qos_state.lock);
+		prepared = kzalloc(sizeof(struct qos_client), GFP_KERNEL);
+		spin_lock(&qos_state.lock);
+		waiter.client = qos_lookup(id, &prepared);
+	}
+	waiter.enqueued = ktime_get_ns();
+	// Clients that have been idle don't get credit for the idle time
+	if (waiter.client->vtime < qos_state.vclock) {
+		waiter.client->vtime = qos_state.vclock;
+	}
+	if (!qos_state.owner && list_empty(&qos_state.waiting)) {
+		qos_grant(waiter.client, waiter.enqueued);
+		spin_unlock(&qos_state.lock);
+		kfree(prepared);
+		return;
+	}
+	init_completion(&waiter.granted);
+	list_add_tail(&waiter.node, &qos_state.waiting);
+	spin_unlock(&qos_state.lock);
+	kfree(prepared);
+
+	wait_for_completion(&waiter.granted);
+}
+
+static int virt_qos_trylock_bus(struct i2c_adapter *adap, unsigned int flags) {
+	struct qos_client *client;
+	int ret = 0;
+
+	spin_lock(&qos_state.lock);
+	if (!qos_state.owner && list_empty(&qos_state.waiting)) {
+		client = qos_find(qos_current_id());
+		qos_grant(client ? client : &qos_state.fallback, ktime_get_ns());
+		ret = 1;
+	}
+	spin_unlock(&qos_state.lock);
+	return ret;
+}
+
+static void virt_qos_unlock_bus(struct i2c_adapter *adap, unsigned int flags) {
+	struct qos_client *client;
+	struct qos_waiter *next;
+	u64 hold;
+
+	spin_lock(&qos_state.lock);
+	client = qos_state.owner;
+	hold = ktime_get_ns() - qos_state.hold_start;
+	client->hold_total += hold;
+	client->vtime += div_u64(hold * QOS_DEFAULT_WEIGHT, client->weight);
+	qos_state.owner = NULL;
+
+	next = qos_select();
+	if (next) {
+		list_del(&next->node);
+		qos_grant(next->client, next->enqueued);
+		complete(&next->granted);
+	}
+	spin_unlock(&qos_state.lock);
+}
+
+const struct i2c_lock_operations virt_qos_lock_ops = {
+	.lock_bus = virt_qos_lock_bus,
+	.trylock_bus = virt_qos_trylock_bus,
+	.unlock_bus = virt_qos_unlock_bus,
+};
+
+static int qos_show_client(char *buf, int at, const char *name,
+		struct qos_client *client) {
+	return sysfs_emit_at(buf, at, "%s %u %u %llu %llu %llu %llu\n", name,
+			client->weight, client->class, client->count,
+			div_u64(client->wait_total, NSEC_PER_USEC),
+			div_u64(client->wait_max, NSEC_PER_USEC),
+			div_u64(client->hold_total, NSEC_PER_USEC));
+}
+
+/**
+ * Shows a line for each client with id, weight, class, number of
+ * transfers, total and maximum wait time and total hold time (us).
+ */
+static ssize_t qos_show(struct device *dev, struct device_attribute *attr,
+		char *buf) {
+	struct qos_client *client;
+	char name[24];
+	int res;
+	int bkt;
+
+	spin_lock(&qos_state.lock);
+	res = qos_show_client(buf, 0, "default", &qos_state.fallback);
+	hash_for_each(qos_state.clients, bkt, client, node) {
+		snprintf(name, sizeof(name), "%llu", client->id);
+		res += qos_show_client(buf, res, name, client);
+	}
+	spin_unlock(&qos_state.lock);
+	return res;
+}
+
+/**
+ * Sets weight and class of the client with the given id or, if id
+ * is 0, the defaults for the clients that haven't been configured.
+ */
+int virt_qos_configure(u64 id, unsigned int weight, unsigned int class) {
+	struct qos_client *prepared;
+	struct qos_client *client;
+	int bkt;
+
+	prepared = kzalloc(sizeof(struct qos_client), GFP_KERNEL);
+	spin_lock(&qos_state.lock);
+	if (id == 0) {
+		// Update all clients that use the defaults
+		hash_for_each(qos_state.clients, bkt, client, node) {
+			if (!client->configured) {
+				client->weight = weight;
+				client->class = class;
+			}
+		}
+		client = &qos_state.fallback;
+	} else {
+		client = qos_lookup(id, &prepared);
+		if (client == &qos_state.fallback) {
+			spin_unlock(&qos_state.lock);
+			kfree(prepared);
+			return -ENOSPC;
+		}
+		client->configured = true;
+	}
+	client->weight = weight;
+	client->class = class;
+	spin_unlock(&qos_state.lock);
+	kfree(prepared);
+	return 0;
+}
+
+/**
+ * Configures a client ("<id> <weight> <class>"), the defaults for
+ * clients that haven't been configured ("default <weight> <class>")
+ * or resets the statistics ("clear").
+ */
+static ssize_t qos_store(struct device *dev, struct device_attribute *attr,
+		const char *buf, size_t count) {
+	struct qos_client *client;
+	unsigned int weight, class;
+	char name[24];
+	u64 id = 0;
+	int bkt;
+	int ret;
+
+	if (sysfs_streq(buf, "clear")) {
+		spin_lock(&qos_state.lock);
+		hash_for_each(qos_state.clients, bkt, client, node) {
+			client->count = 0;
+			client->wait_total = 0;
+			client->wait_max = 0;
+			client->hold_total = 0;
+		}
+		client = &qos_state.fallback;
+		client->count = 0;
+		client->wait_total = 0;
+		client->wait_max = 0;
+		client->hold_total = 0;
+		spin_unlock(&qos_state.lock);
+		return count;
+	}
+
+	if (sscanf(buf, "%23s %u %u", name, &weight, &class) != 3
+			|| weight == 0 || weight > QOS_MAX_WEIGHT
+			|| class >= QOS_CLASSES) {
+		return -EINVAL;
+	}
+	if (strcmp(name, "default") != 0 && kstrtou64(name, 0, &id)) {
+		return -EINVAL;
+	}
+	ret = virt_qos_configure(id, weight, class);
+	return ret ? ret : count;
+}
+
+static DEVICE_ATTR_RW(qos);
+
+static struct attribute *virt_qos_attrs[] = {
+	&dev_attr_qos.attr,
+	NULL,
+};
+
+static const struct attribute_group virt_qos_group = {
+	.attrs = virt_qos_attrs,
+};
+
+static const struct attribute_group *virt_qos_groups[] = {
+	&virt_qos_group,
+	NULL,
+};
+
+/**
+ * Installs the scheduler for the adapter if enabled. Must be called
+ * before the adapter is added.
+ */
+int __init virt_qos_init(struct i2c_adapter *adap) {
+	// Initialized anyway, the scheduler can be used by the KUnit tests
+	spin_lock_init(&qos_state.lock);
+	hash_init(qos_state.clients);
+	INIT_LIST_HEAD(&qos_state.waiting);
+	qos_state.fallback.weight = QOS_DEFAULT_WEIGHT;
+	qos_state.fallback.class = QOS_DEFAULT_CLASS;
+
+	if (!qos) {
+		return 0;
+	}
+	if (strcmp(qos_key, "cgroup") == 0) {
+		if (!IS_ENABLED(CONFIG_CGROUPS)) {
+			return -EINVAL;
+		}
+		qos_state.by_cgroup = true;
+	} else if (strcmp(qos_key, "tgid") != 0) {
+		return -EINVAL;
+	}
+	adap->lock_ops = &virt_qos_lock_ops;
+	adap->dev.groups = virt_qos_groups;
+	pr_info("Scheduling clients by %s\n", qos_key);
+	return 0;
+}
+
+void virt_qos_exit(void) {
+	struct qos_client *client;
+	struct hlist_node *tmp;
+	int bkt;
+
+	hash_for_each_safe(qos_state.clients, bkt, tmp, client, node) {
+		hash_del(&client->node);
+		kfree(client);
+	}
+	qos_state.nclients = 0;
+}
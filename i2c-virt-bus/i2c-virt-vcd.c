@@ -0,0 +1,406 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+    i2c-virt-vcd.c - Exports the activity of the master as VCD
+
+    Copyright (C) 2020-2020 Michael Lipp <mnl@mnl.de>
+
+    While the file "vcd" in the module's debugfs directory is open,
+    the master records the start and stop conditions and the bytes
+    transferred in a ring buffer. Reading the file turns the recorded
+    events into the edges of SCL and SDA in value change dump format.
+    The timing of the edges is derived from the bus clock, the time
+    between transfers is the time that has actually passed.
+*/
+
+#define DEBUG 1
+#define pr_fmt(fmt) "i2c-virt-vcd: " fmt
+
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/err.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/i2c.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+
+#include "i2c-virt-hub.h"
+
+static unsigned int vcd_clock = 100000;
+module_param(vcd_clock, uint, 0644);
+MODULE_PARM_DESC(vcd_clock, "Bus clock (Hz) used for the VCD export");
+
+static unsigned int vcd_events = 65536;
+module_param(vcd_events, uint, 0444);
+MODULE_PARM_DESC(vcd_events, "Size of the VCD export's ring buffer (events)");
+
+enum vcd_type { VCD_START, VCD_RESTART, VCD_BYTE, VCD_STOP };
+
+/**
+ * An event as recorded by the master.
+ */
+struct vcd_event {
+	/** Bus time in ns since the file was opened. */
+	u64 time;
+	u8 type;
+	u8 data;
+	u8 nack;
+};
+
+/**
+ * The state of the recording. The events are produced by the
+ * master while it holds its bus lock and consumed by the (single)
+ * reader, so the fifo needs no locking.
+ */
+static struct {
+	DECLARE_KFIFO_PTR(fifo, struct vcd_event);
+	wait_queue_head_t wait;
+	unsigned long busy;
+	bool active;
+	/** ktime when the recording was started. */
+	u64 start;
+	/** The bus time at the end of the last event. */
+	u64 now;
+	/** The duration of a clock cycle (ns). */
+	u32 period;
+	atomic_long_t dropped;
+} vcd;
+
+/**
+ * The state of an open file. Holds the text generated from the
+ * events that hasn't been read yet.
+ */
+struct vcd_reader {
+	struct mutex lock;
+	bool header_sent;
+	u8 scl;
+	u8 sda;
+	u64 time;
+	size_t pos;
+	size_t len;
+	char text[PAGE_SIZE];
+};
+
+/** The space required for the text of an event. */
+#define VCD_EVENT_TEXT 1024
+
+bool virt_vcd_active(void) {
+	return READ_ONCE(vcd.active);
+}
+
+static void vcd_record(u8 type, u8 data, u8 nack, u32 duration) {
+	struct vcd_event event = {
+		.time = vcd.now, .type = type, .data = data, .nack = nack
+	};
+
+	if (!kfifo_put(&vcd.fifo, event)) {
+		atomic_long_inc(&vcd.dropped);
+	}
+	vcd.now += duration;
+}
+
+/**
+ * Records a start condition. A repeated start follows the previous
+ * byte immediately, a start from idle happens no earlier than now.
+ * Must be called with the master's bus locked.
+ */
+void virt_vcd_start(bool repeated) {
+	u64 now;
+
+	if (repeated) {
+		vcd_record(VCD_RESTART, 0, 0, vcd.period);
+		return;
+	}
+	now = ktime_get_ns() - vcd.start;
+	if (now > vcd.now) {
+		vcd.now = now;
+	}
+	vcd_record(VCD_START, 0, 0, vcd.period / 2);
+}
+
+/**
+ * Records the bytes transferred. The last byte is acknowledged
+ * unless nack_last is set.
+ */
+void virt_vcd_bytes(const u8 *buf, size_t len, bool nack_last) {
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		vcd_record(VCD_BYTE, buf[i], nack_last && i == len - 1,
+				9 * vcd.period);
+	}
+}
+
+/**
+ * Records a stop condition and wakes up the reader.
+ */
+void virt_vcd_stop(void) {
+	vcd_record(VCD_STOP, 0, 0, vcd.period);
+	wake_up_interruptible(&vcd.wait);
+}
+
+/*
+ * Output
+ */
+
+static void vcd_printf(struct vcd_reader *reader, const char *fmt, ...) {
+	va_list args;
+
+	va_start(args, fmt);
+	reader->len += vscnprintf(reader->text + reader->len,
+			sizeof(reader->text) - reader->len, fmt, args);
+	va_end(args);
+}
+
+/**
+ * Adds a value change of SCL ('!') or SDA ('"').
+ */
+static void vcd_change(struct vcd_reader *reader, u64 time, char id, u8 value) {
+	u8 *state = id == '!' ? &reader->scl : &reader->sda;
+
+	if (*state == value) {
+		return;
+	}
+	if (time != reader->time) {
+		vcd_printf(reader, "#%llu\n", time);
+		reader->time = time;
+	}
+	vcd_printf(reader, "%u%c\n", value, id);
+	*state = value;
+}
+
+static void vcd_header(struct vcd_reader *reader) {
+	vcd_printf(reader, "$version i2c-virt-bus $end\n"
+			"$comment bus clock %u Hz $end\n"
+			"$timescale 1ns $end\n"
+			"$scope module i2c $end\n"
+			"$var wire 1 ! scl $end\n"
+			"$var wire 1 \" sda $end\n"
+			"$upscope $end\n"
+			"$enddefinitions $end\n"
+			"#0\n$dumpvars\n1!\n1\"\n$end\n",
+			(unsigned int)(NSEC_PER_SEC / vcd.period));
+	reader->scl = 1;
+	reader->sda = 1;
+	reader->time = 0;
+	reader->header_sent = true;
+}
+
+/**
+ * Converts an event to edges. All events start with SCL low,
+ * except for the start from idle. During each clock cycle, SDA
+ * changes after a quarter of the cycle, SCL is high during the
+ * second half.
+ */
+static void vcd_expand(struct vcd_reader *reader, struct vcd_event *event) {
+	u32 period = vcd.period;
+	u64 t = event->time;
+	int bit;
+
+	switch (event->type) {
+	case VCD_START:
+		vcd_change(reader, t, '"', 0);
+		vcd_change(reader, t + period / 2, '!', 0);
+		break;
+
+	case VCD_RESTART:
+		vcd_change(reader, t + period / 4, '"', 1);
+		vcd_change(reader, t + period / 2, '!', 1);
+		vcd_change(reader, t + 3 * period / 4, '"', 0);
+		vcd_change(reader, t + period, '!', 0);
+		break;
+
+	case VCD_BYTE:
+		for (bit = 0; bit < 9; bit++, t += period) {
+			vcd_change(reader, t + period / 4, '"',
+					bit < 8 ? (event->data >> (7 - bit)) & 1 : event->nack);
+			vcd_change(reader, t + period / 2, '!', 1);
+			vcd_change(reader, t + period, '!', 0);
+		}
+		break;
+
+	case VCD_STOP:
+		vcd_change(reader, t + period / 4, '"', 0);
+		vcd_change(reader, t + period / 2, '!', 1);
+		vcd_change(reader, t + 3 * period / 4, '"', 1);
+		break;
+	}
+}
+
+/**
+ * Fills the text buffer. Returns false if there was nothing to add.
+ */
+static bool vcd_fill(struct vcd_reader *reader) {
+	struct vcd_event event;
+	long dropped;
+
+	reader->pos = 0;
+	reader->len = 0;
+	if (!reader->header_sent) {
+		vcd_header(reader);
+	}
+	dropped = atomic_long_xchg(&vcd.dropped, 0);
+	if (dropped) {
+		vcd_printf(reader, "$comment %ld events dropped $end\n", dropped);
+	}
+	while (sizeof(reader->text) - reader->len >= VCD_EVENT_TEXT
+			&& kfifo_get(&vcd.fifo, &event)) {
+		vcd_expand(reader, &event);
+	}
+	return reader->len > 0;
+}
+
+/**
+ * Starts recording for a new reader. Only one reader at a time is
+ * supported. Used by the file and the KUnit tests.
+ */
+struct vcd_reader *virt_vcd_begin(void) {
+	struct vcd_reader *reader;
+
+	if (test_and_set_bit(0, &vcd.busy)) {
+		return ERR_PTR(-EBUSY);
+	}
+	reader = kzalloc(sizeof(struct vcd_reader), GFP_KERNEL);
+	if (!reader) {
+		clear_bit(0, &vcd.busy);
+		return ERR_PTR(-ENOMEM);
+	}
+	mutex_init(&reader->lock);
+
+	// Start recording
+	i2c_lock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	kfifo_reset(&vcd.fifo);
+	atomic_long_set(&vcd.dropped, 0);
+	vcd.period = NSEC_PER_SEC / clamp(vcd_clock, 1000U, 5000000U);
+	vcd.start = ktime_get_ns();
+	vcd.now = 0;
+	WRITE_ONCE(vcd.active, true);
+	i2c_unlock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	return reader;
+}
+
+/**
+ * Stops recording and frees the reader.
+ */
+void virt_vcd_end(struct vcd_reader *reader) {
+	i2c_lock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+	WRITE_ONCE(vcd.active, false);
+	i2c_unlock_bus(&virt_master_adapter, I2C_LOCK_ROOT_ADAPTER);
+
+	kfree(reader);
+	clear_bit(0, &vcd.busy);
+}
+
+/**
+ * Copies the text for the events recorded so far to buf, without
+ * waiting for further events. Returns the number of bytes copied.
+ */
+size_t virt_vcd_text(struct vcd_reader *reader, char *buf, size_t count) {
+	size_t copied = 0;
+	size_t chunk;
+
+	mutex_lock(&reader->lock);
+	while (copied < count
+			&& (reader->pos < reader->len || vcd_fill(reader))) {
+		chunk = min(count - copied, reader->len - reader->pos);
+		memcpy(buf + copied, reader->text + reader->pos, chunk);
+		reader->pos += chunk;
+		copied += chunk;
+	}
+	mutex_unlock(&reader->lock);
+	return copied;
+}
+
+static int virt_vcd_open(struct inode *inode, struct file *file) {
+	struct vcd_reader *reader = virt_vcd_begin();
+
+	if (IS_ERR(reader)) {
+		return PTR_ERR(reader);
+	}
+	file->private_data = reader;
+	return nonseekable_open(inode, file);
+}
+
+static int virt_vcd_release(struct inode *inode, struct file *file) {
+	virt_vcd_end(file->private_data);
+	return 0;
+}
+
+static ssize_t virt_vcd_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos) {
+	struct vcd_reader *reader = file->private_data;
+	size_t chunk;
+	ssize_t ret;
+
+	if (mutex_lock_interruptible(&reader->lock)) {
+		return -ERESTARTSYS;
+	}
+	while (reader->pos == reader->len && !vcd_fill(reader)) {
+		if (file->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto unlock;
+		}
+		mutex_unlock(&reader->lock);
+		if (wait_event_interruptible(vcd.wait,
+				!kfifo_is_empty(&vcd.fifo)
+				|| atomic_long_read(&vcd.dropped))) {
+			return -ERESTARTSYS;
+		}
+		if (mutex_lock_interruptible(&reader->lock)) {
+			return -ERESTARTSYS;
+		}
+	}
+	chunk = min(count, reader->len - reader->pos);
+	if (copy_to_user(buf, reader->text + reader->pos, chunk)) {
+		ret = -EFAULT;
+		goto unlock;
+	}
+	reader->pos += chunk;
+	ret = chunk;
+
+ unlock:
+	mutex_unlock(&reader->lock);
+	return ret;
+}
+
+static __poll_t virt_vcd_poll(struct file *file, poll_table *wait) {
+	struct vcd_reader *reader = file->private_data;
+
+	poll_wait(file, &vcd.wait, wait);
+	if (reader->pos < reader->len || !kfifo_is_empty(&vcd.fifo)
+			|| atomic_long_read(&vcd.dropped)) {
+		return EPOLLIN | EPOLLRDNORM;
+	}
+	return 0;
+}
+
+static const struct file_operations virt_vcd_fops = {
+	.owner = THIS_MODULE,
+	.open = virt_vcd_open,
+	.release = virt_vcd_release,
+	.read = virt_vcd_read,
+	.poll = virt_vcd_poll,
+};
+
+int __init virt_vcd_init(struct dentry *dir) {
+	int ret;
+
+	init_waitqueue_head(&vcd.wait);
+	ret = kfifo_alloc(&vcd.fifo, max(vcd_events, 64U), GFP_KERNEL);
+	if (ret) {
+		return ret;
+	}
+	debugfs_create_file("vcd", 0400, dir, NULL, &virt_vcd_fops);
+	return 0;
+}
+
+void virt_vcd_exit(void) {
+	kfifo_free(&vcd.fifo);
+}
@@ -0,0 +1,188 @@
+/*
+ * Linearizability.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Linearizability.h"
+
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+
+namespace {
+
+/**
+ * An invocation or response event in the doubly linked list of
+ * events that have not been linearized yet.
+ */
+struct Event {
+	bool isCall;
+	/** The index of the operation. */
+	size_t op;
+	uint64_t time;
+	/** For a call, the index of the response. */
+	size_t match;
+	size_t prev;
+	size_t next;
+};
+
+const size_t none = (size_t)-1;
+
+/**
+ * The set of linearized operations together with the resulting
+ * state. Configurations that have been visited before need not
+ * be explored again. The set of linearized operations is
+ * represented by two (Zobrist) hashes, which keeps the cache
+ * small for long histories.
+ */
+struct Config {
+	uint64_t linearized[2];
+	int64_t state;
+
+	bool operator==(const Config& other) const {
+		return state == other.state
+				&& linearized[0] == other.linearized[0]
+				&& linearized[1] == other.linearized[1];
+	}
+};
+
+struct ConfigHash {
+	size_t operator()(const Config& config) const {
+		return config.linearized[0] ^ std::hash<int64_t>()(config.state);
+	}
+};
+
+class Checker {
+public:
+	Checker(const Model& model, const std::vector<Operation>& ops)
+			: model(model), ops(ops) {
+		// The list of events, calls are sorted before responses
+		// with the same time (i.e. the operations overlap)
+		for (size_t i = 0; i < ops.size(); i++) {
+			events.push_back({ true, i, ops[i].call, none, none, none });
+			events.push_back({ false, i, ops[i].ret, none, none, none });
+		}
+		std::sort(events.begin(), events.end(),
+				[](const Event& a, const Event& b) {
+					if (a.time != b.time) {
+						return a.time < b.time;
+					}
+					return a.isCall && !b.isCall;
+				});
+		std::vector<size_t> response(ops.size());
+		for (size_t i = 0; i < events.size(); i++) {
+			events[i].prev = i == 0 ? none : i - 1;
+			events[i].next = i + 1 == events.size() ? none : i + 1;
+			if (!events[i].isCall) {
+				response[events[i].op] = i;
+			}
+		}
+		for (Event& event : events) {
+			if (event.isCall) {
+				event.match = response[event.op];
+			}
+		}
+		head = events.empty() ? none : 0;
+		std::mt19937_64 rng(ops.size());
+		for (size_t i = 0; i < ops.size(); i++) {
+			keys.push_back({ rng(), rng() });
+		}
+	}
+
+	bool check() {
+		Config config { { 0, 0 }, model.init };
+		std::vector<std::pair<size_t, int64_t>> stack;
+		size_t entry = head;
+
+		while (head != none) {
+			Event& event = events[entry];
+			if (event.isCall) {
+				int64_t state = config.state;
+				if (model.step(state, ops[event.op])) {
+					Config next = config;
+					toggle(next, event.op);
+					next.state = state;
+					if (visited.insert(next).second) {
+						stack.push_back({ entry, config.state });
+						config = next;
+						lift(entry);
+						entry = head;
+						continue;
+					}
+				}
+				entry = event.next;
+				continue;
+			}
+
+			// Reached a response without linearizing its operation
+			if (stack.empty()) {
+				return false;
+			}
+			entry = stack.back().first;
+			config.state = stack.back().second;
+			stack.pop_back();
+			toggle(config, events[entry].op);
+			unlift(entry);
+			entry = events[entry].next;
+		}
+		return true;
+	}
+
+private:
+	const Model& model;
+	const std::vector<Operation>& ops;
+	std::vector<Event> events;
+	size_t head = none;
+	std::vector<std::pair<uint64_t, uint64_t>> keys;
+	std::unordered_set<Config, ConfigHash> visited;
+
+	/** Adds or removes the operation from the linearized ones. */
+	void toggle(Config& config, size_t op) {
+		config.linearized[0] ^= keys[op].first;
+		config.linearized[1] ^= keys[op].second;
+	}
+
+	void unlink(size_t entry) {
+		Event& event = events[entry];
+		if (event.prev == none) {
+			head = event.next;
+		} else {
+			events[event.prev].next = event.next;
+		}
+		if (event.next != none) {
+			events[event.next].prev = event.prev;
+		}
+	}
+
+	void relink(size_t entry) {
+		Event& event = events[entry];
+		if (event.prev == none) {
+			head = entry;
+		} else {
+			events[event.prev].next = entry;
+		}
+		if (event.next != none) {
+			events[event.next].prev = entry;
+		}
+	}
+
+	/** Removes the call and its response from the list. */
+	void lift(size_t entry) {
+		unlink(entry);
+		unlink(events[entry].match);
+	}
+
+	/** Reinserts the call and its response (in reverse order). */
+	void unlift(size_t entry) {
+		relink(events[entry].match);
+		relink(entry);
+	}
+};
+
+}
+
+bool isLinearizable(const Model& model, const std::vector<Operation>& ops) {
+	return Checker(model, ops).check();
+}
@@ -0,0 +1,54 @@
+/*
+ * Linearizability.h
+ *
+ * Checks histories of operations on a single object for
+ * linearizability (Wing & Gong's algorithm with the state cache
+ * proposed by Lowe).
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef LINEARIZABILITY_H_
+#define LINEARIZABILITY_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * An operation as recorded by a worker.
+ */
+struct Operation {
+	/** The object that the operation was applied to. */
+	uint8_t object;
+	/** The kind of operation (depends on the model). */
+	uint8_t kind;
+	/** Set if the operation failed. */
+	uint8_t failed;
+	uint8_t reserved;
+	/** The value written or the value read. */
+	int32_t value;
+	/** The time of the invocation and of the response (ns). */
+	uint64_t call;
+	uint64_t ret;
+};
+
+/**
+ * A sequential specification of an object. The state must fit in
+ * an int64_t. The step function returns false if the operation
+ * (with its recorded result) is not possible in the given state.
+ * Otherwise it updates the state.
+ */
+struct Model {
+	int64_t init;
+	std::function<bool(int64_t& state, const Operation& op)> step;
+};
+
+/**
+ * Checks if the operations (all on the same object) are
+ * linearizable with respect to the model.
+ */
+bool isLinearizable(const Model& model, const std::vector<Operation>& ops);
+
+#endif /* LINEARIZABILITY_H_ */
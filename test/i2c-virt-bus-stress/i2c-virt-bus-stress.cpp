@@ -0,0 +1,449 @@
+/*
+ * i2c-virt-bus-stress.cpp
+ *
+ * Accesses the simulated devices from several threads in several
+ * processes at once, records the histories of the operations and
+ * checks them for linearizability and torn values. Reports the
+ * throughput for increasing numbers of threads.
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "client/Ds1621.h"
+#include "client/Eeprom24Cxx.h"
+#include "Linearizability.h"
+
+#ifndef EEPROM_ADDR
+#define EEPROM_ADDR 0x51
+#endif
+#ifndef DS1621_ADDR
+#define DS1621_ADDR 0x48
+#endif
+
+/** The EEPROM (24C32) pages used by the test. */
+static const size_t pageSize = 32;
+static const size_t pageBase = 0x800;
+static const int pages = 8;
+
+/**
+ * The objects, the EEPROM pages are objects 0 to pages - 1.
+ */
+enum Objects { objTh = pages, objTl, objTemperature, objects };
+
+enum Kinds { opWrite, opRead, opStart, opStop };
+
+struct Options {
+	int bus = -1;
+	int hub = -1;
+	int processes = 2;
+	int maxThreads = 8;
+	double duration = 1;
+	size_t capacity = 100000;
+};
+
+/**
+ * The statistics of a worker, kept in shared memory.
+ */
+struct WorkerStats {
+	uint64_t count;
+	uint64_t torn;
+	uint64_t errors;
+};
+
+static void usage() {
+	std::cerr << "Usage: i2c-virt-bus-stress [-b bus] [-h hub] [-p processes]"
+			" [-t max threads] [-d duration] [-n max ops per thread]"
+			<< std::endl;
+	exit(2);
+}
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static std::string temperatureFile(const Options& opts) {
+	char device[16];
+	snprintf(device, sizeof(device), "%d-%04x", opts.hub, 0x1000 | DS1621_ADDR);
+	return "/sys/devices/i2c-" + std::to_string(opts.hub) + "/" + device
+			+ "/temperature";
+}
+
+/**
+ * Stores the temperature (in half degrees) using sysfs.
+ */
+static void storeTemperature(int fd, int value) {
+	std::string data = std::to_string(value * 500);
+	if (pwrite(fd, data.c_str(), data.size(), 0) < 0) {
+		throw std::system_error(errno, std::generic_category(),
+				"Storing temperature");
+	}
+}
+
+/*
+ * The values written to the EEPROM pages are 32 bit values that are
+ * repeated in the page. The values written to TH and TL have the
+ * complement of the high byte in the low byte. A value read that
+ * doesn't have these properties is torn.
+ */
+
+static void fillPage(uint8_t *page, uint32_t value) {
+	for (size_t i = 0; i < pageSize; i += 4) {
+		memcpy(page + i, &value, 4);
+	}
+}
+
+static bool checkPage(const uint8_t *page, uint32_t *value) {
+	memcpy(value, page, 4);
+	for (size_t i = 4; i < pageSize; i += 4) {
+		if (memcmp(page, page + i, 4) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint16_t thresholdValue(uint8_t value) {
+	return value << 8 | (uint8_t)~value;
+}
+
+static bool checkThreshold(uint16_t raw) {
+	return (raw & 0xff) == (uint8_t)~(raw >> 8);
+}
+
+/**
+ * Brings all objects in the initial state assumed by the models.
+ */
+static void reset(const Options& opts) {
+	i2c::I2cBus bus(opts.bus);
+	i2c::Ds1621 ds1621(bus, DS1621_ADDR);
+	i2c::Eeprom24Cxx eeprom = i2c::Eeprom24Cxx::at24c32(bus, EEPROM_ADDR);
+
+	std::vector<uint8_t> zero(pages * pageSize);
+	eeprom.write(pageBase, zero.data(), zero.size());
+	ds1621.setTh(thresholdValue(0));
+	ds1621.setTl(thresholdValue(0));
+	ds1621.setConfig(ds1621.config() & ~i2c::Ds1621::config1Shot);
+	int fd = open(temperatureFile(opts).c_str(), O_WRONLY);
+	if (fd < 0) {
+		throw std::system_error(errno, std::generic_category(),
+				"Cannot open " + temperatureFile(opts));
+	}
+	storeTemperature(fd, 0);
+	close(fd);
+	ds1621.startConversion();
+	ds1621.stopConversion();
+}
+
+/**
+ * Executes random operations until the end time has been reached
+ * or the history is full.
+ */
+static void worker(const Options& opts, int id, uint64_t start, uint64_t end,
+		WorkerStats *stats, Operation *ops) {
+	std::mt19937 rng(id);
+	uint32_t seq = 0;
+	int fd = -1;
+
+	try {
+		i2c::I2cBus bus(opts.bus);
+		i2c::Ds1621 ds1621(bus, DS1621_ADDR);
+		i2c::Eeprom24Cxx eeprom = i2c::Eeprom24Cxx::at24c32(bus, EEPROM_ADDR);
+		fd = open(temperatureFile(opts).c_str(), O_WRONLY);
+		if (fd < 0) {
+			throw std::system_error(errno, std::generic_category(),
+					"Cannot open " + temperatureFile(opts));
+		}
+		std::this_thread::sleep_for(
+				std::chrono::nanoseconds((int64_t)(start - now())));
+
+		uint8_t page[pageSize];
+		while (stats->count < opts.capacity) {
+			Operation op {};
+			int choice = rng() % 100;
+			op.call = now();
+			if (op.call >= end) {
+				break;
+			}
+			try {
+				if (choice < 15) {
+					op.object = rng() % pages;
+					op.kind = opWrite;
+					op.value = id << 24 | (++seq & 0xffffff);
+					fillPage(page, op.value);
+					eeprom.write(pageBase + op.object * pageSize, page, pageSize);
+				} else if (choice < 35) {
+					op.object = rng() % pages;
+					op.kind = opRead;
+					eeprom.read(pageBase + op.object * pageSize, page, pageSize);
+					uint32_t value;
+					if (!checkPage(page, &value)) {
+						stats->torn += 1;
+					}
+					op.value = value;
+				} else if (choice < 55) {
+					op.object = (choice & 1) ? objTh : objTl;
+					op.kind = opWrite;
+					op.value = rng() & 0xff;
+					if (op.object == objTh) {
+						ds1621.setTh(thresholdValue(op.value));
+					} else {
+						ds1621.setTl(thresholdValue(op.value));
+					}
+				} else if (choice < 65) {
+					op.object = (choice & 1) ? objTh : objTl;
+					op.kind = opRead;
+					uint16_t raw = op.object == objTh ? ds1621.th() : ds1621.tl();
+					if (!checkThreshold(raw)) {
+						stats->torn += 1;
+					}
+					op.value = raw >> 8;
+				} else if (choice < 80) {
+					op.object = objTemperature;
+					op.kind = opRead;
+					op.value = lround(ds1621.temperature() * 2);
+				} else if (choice < 92) {
+					op.object = objTemperature;
+					op.kind = opWrite;
+					op.value = (int)(rng() % 161) - 80;
+					storeTemperature(fd, op.value);
+				} else if (choice < 97) {
+					op.object = objTemperature;
+					op.kind = opStart;
+					ds1621.startConversion();
+				} else {
+					op.object = objTemperature;
+					op.kind = opStop;
+					ds1621.stopConversion();
+				}
+			} catch (const std::system_error& e) {
+				op.failed = 1;
+				stats->errors += 1;
+			}
+			op.ret = now();
+			ops[stats->count++] = op;
+		}
+	} catch (const std::system_error& e) {
+		std::cerr << "Worker " << id << ": " << e.what() << std::endl;
+		stats->errors += 1;
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+/**
+ * A register (EEPROM page, threshold).
+ */
+static const Model registerModel = { 0,
+	[](int64_t& state, const Operation& op) {
+		if (op.kind == opWrite) {
+			state = op.value;
+			return true;
+		}
+		return op.value == state;
+	} };
+
+/**
+ * The temperature. The state consists of the stored ("sensor")
+ * temperature, the measured temperature and the conversion state.
+ */
+static const Model temperatureModel = { 0,
+	[](int64_t& state, const Operation& op) {
+		int16_t stored = state & 0xffff;
+		int16_t measured = (state >> 16) & 0xffff;
+		bool converting = state >> 32;
+		switch (op.kind) {
+		case opWrite:
+			stored = op.value;
+			if (converting) {
+				measured = stored;
+			}
+			break;
+		case opRead:
+			return op.value == measured;
+		case opStart:
+			measured = stored;
+			converting = true;
+			break;
+		case opStop:
+			converting = false;
+			break;
+		}
+		// Unsigned, a negative temperature must not sign-extend
+		state = (int64_t)((uint64_t)converting << 32
+				| (uint64_t)(uint16_t)measured << 16
+				| (uint64_t)(uint16_t)stored);
+		return true;
+	} };
+
+/**
+ * Runs the workers in the given number of processes with the
+ * given number of threads each. Returns false if a problem has
+ * been detected.
+ */
+static bool run(const Options& opts, int threads) {
+	reset(opts);
+
+	int workers = opts.processes * threads;
+	size_t statsSize = workers * sizeof(WorkerStats);
+	size_t size = statsSize + workers * opts.capacity * sizeof(Operation);
+	void *shared = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		throw std::system_error(errno, std::generic_category(), "mmap");
+	}
+	WorkerStats *stats = (WorkerStats*)shared;
+	Operation *history = (Operation*)((char*)shared + statsSize);
+
+	// Start all workers at the same time
+	uint64_t start = now() + 100000000;
+	uint64_t end = start + (uint64_t)(opts.duration * 1e9);
+	std::vector<pid_t> children;
+	for (int p = 0; p < opts.processes; p++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			throw std::system_error(errno, std::generic_category(), "fork");
+		}
+		if (pid == 0) {
+			std::vector<std::thread> running;
+			for (int t = 0; t < threads; t++) {
+				int id = p * threads + t;
+				running.emplace_back(worker, std::cref(opts), id, start, end,
+						stats + id, history + id * opts.capacity);
+			}
+			for (auto& thread : running) {
+				thread.join();
+			}
+			_exit(0);
+		}
+		children.push_back(pid);
+	}
+	for (pid_t pid : children) {
+		waitpid(pid, nullptr, 0);
+	}
+
+	// Collect
+	uint64_t total = 0, torn = 0, errors = 0, last = start;
+	std::vector<std::vector<Operation>> byObject(objects);
+	std::vector<bool> failed(objects);
+	for (int w = 0; w < workers; w++) {
+		total += stats[w].count;
+		torn += stats[w].torn;
+		errors += stats[w].errors;
+		for (uint64_t i = 0; i < stats[w].count; i++) {
+			const Operation& op = history[w * opts.capacity + i];
+			if (op.failed) {
+				// May or may not have taken effect
+				failed[op.object] = true;
+				continue;
+			}
+			byObject[op.object].push_back(op);
+			last = std::max(last, op.ret);
+		}
+	}
+	munmap(shared, size);
+
+	int violations = 0, unchecked = 0;
+	for (int o = 0; o < objects; o++) {
+		if (failed[o]) {
+			unchecked += 1;
+			continue;
+		}
+		const Model& model = o == objTemperature
+				? temperatureModel : registerModel;
+		if (!isLinearizable(model, byObject[o])) {
+			violations += 1;
+			std::cout << "  History of "
+					<< (o < pages ? "EEPROM page " + std::to_string(o)
+						: o == objTh ? std::string("TH")
+						: o == objTl ? std::string("TL")
+						: std::string("temperature"))
+					<< " is not linearizable" << std::endl;
+		}
+	}
+
+	double secs = (last - start) / 1e9;
+	printf("%7d %7d %12.0f %6lu %6lu %10d %9d\n", threads, workers,
+			secs > 0 ? total / secs : 0, (unsigned long)torn,
+			(unsigned long)errors, violations, unchecked);
+	fflush(stdout);
+	return torn == 0 && errors == 0 && violations == 0;
+}
+
+int main(int argc, char **argv) {
+	Options opts;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:h:p:t:d:n:")) != -1) {
+		switch (opt) {
+		case 'b':
+			opts.bus = atoi(optarg);
+			break;
+		case 'h':
+			opts.hub = atoi(optarg);
+			break;
+		case 'p':
+			opts.processes = atoi(optarg);
+			break;
+		case 't':
+			opts.maxThreads = atoi(optarg);
+			break;
+		case 'd':
+			opts.duration = atof(optarg);
+			break;
+		case 'n':
+			opts.capacity = atol(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || opts.processes < 1 || opts.maxThreads < 1
+			|| opts.duration <= 0 || opts.capacity < 1) {
+		usage();
+	}
+	if (opts.bus < 0) {
+		if (getenv("I2C_BUS_NUM") == nullptr) {
+			std::cerr << "Bus neither specified nor set as I2C_BUS_NUM"
+					" in environment" << std::endl;
+			return 2;
+		}
+		opts.bus = atoi(getenv("I2C_BUS_NUM"));
+	}
+	if (opts.hub < 0) {
+		// Created by setup-test
+		opts.hub = opts.bus - 1;
+	}
+
+	bool ok = true;
+	try {
+		printf("%7s %7s %12s %6s %6s %10s %9s\n", "threads", "workers",
+				"ops/s", "torn", "errors", "violations", "unchecked");
+		for (int threads = 1; threads <= opts.maxThreads; threads *= 2) {
+			ok = run(opts, threads) && ok;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 2;
+	}
+	return ok ? 0 : 1;
+}
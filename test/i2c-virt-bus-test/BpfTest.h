@@ -0,0 +1,77 @@
+/*
+ * BpfTest.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef BPFTEST_H_
+#define BPFTEST_H_
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <stdlib.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "client/I2cBus.h"
+
+class BpfTest : public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE(BpfTest);
+	CPPUNIT_TEST(testNoModel);
+	CPPUNIT_TEST(testRegfile);
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	std::unique_ptr<i2c::I2cBus> bus;
+	std::string modelFile;
+	/**
+	 * The slave-bpf device, the sample model "regfile" has been
+	 * registered (see setup-test).
+	 */
+	const uint16_t bpfAddr = 0x52;
+
+	void selectModel(const std::string& name) {
+		std::ofstream model(modelFile);
+		model << name << std::endl;
+		model.close();
+		CPPUNIT_ASSERT_MESSAGE("Cannot select model", !model.fail());
+	}
+
+public:
+	void setUp() {
+		CPPUNIT_ASSERT_MESSAGE("I2C_BUS_NUM not set in environment",
+				getenv("I2C_BUS_NUM") != nullptr);
+		int busNum = stoi(std::string(getenv("I2C_BUS_NUM")));
+		bus.reset(new i2c::I2cBus(busNum));
+		modelFile = "/sys/bus/i2c/devices/" + std::to_string(busNum - 1)
+				+ "-1052/model";
+	}
+
+	void tearDown() {
+		selectModel("");
+		bus.reset();
+	}
+
+	void testNoModel() {
+		// Behaves like an erased EEPROM
+		selectModel("unknown");
+		uint8_t reg = 0;
+		uint8_t in[2] = { 0 };
+		bus->writeRead(bpfAddr, &reg, 1, in, sizeof(in));
+		CPPUNIT_ASSERT(in[0] == 0xff && in[1] == 0xff);
+	}
+
+	void testRegfile() {
+		// The events are passed to the model's BPF program
+		selectModel("regfile");
+		uint8_t out[] = { 0x10, 0xa5, 0x5a };
+		bus->write(bpfAddr, out, sizeof(out));
+		uint8_t in[2] = { 0 };
+		bus->writeRead(bpfAddr, out, 1, in, sizeof(in));
+		CPPUNIT_ASSERT(in[0] == 0xa5 && in[1] == 0x5a);
+	}
+};
+
+#endif /* BPFTEST_H_ */
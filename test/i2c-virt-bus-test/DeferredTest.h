@@ -0,0 +1,124 @@
+/*
+ * DeferredTest.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef DEFERREDTEST_H_
+#define DEFERREDTEST_H_
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "client/I2cBus.h"
+
+class DeferredTest : public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE(DeferredTest);
+	CPPUNIT_TEST(testTransfer);
+	CPPUNIT_TEST(testNotBlocking);
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	std::unique_ptr<i2c::I2cBus> bus;
+	int busNum;
+	/** Where sysfs is mounted (see I2C_SYSFS_ROOT). */
+	std::string sysFsRoot;
+	/** The 24c02 and the DS1621 (see setup-test). */
+	const uint16_t eepromAddr = 0x50;
+	const uint16_t ds1621Addr = 0x48;
+	/** Modeled processing time of the deferred EEPROM in µs. */
+	const int delay = 200000;
+
+	/** Writes the setting to the root hub's file "deferred". */
+	void setDeferred(const std::string& setting) {
+		std::ofstream deferred(sysFsRoot + "/bus/i2c/devices/i2c-"
+				+ std::to_string(busNum - 1) + "/deferred");
+		deferred << setting;
+		deferred.close();
+		CPPUNIT_ASSERT_MESSAGE("Cannot set deferred", !deferred.fail());
+	}
+
+	static long elapsedMs(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - start).count();
+	}
+
+public:
+	void setUp() {
+		CPPUNIT_ASSERT_MESSAGE("I2C_BUS_NUM not set in environment",
+				getenv("I2C_BUS_NUM") != nullptr);
+		busNum = stoi(std::string(getenv("I2C_BUS_NUM")));
+		bus.reset(new i2c::I2cBus(busNum));
+		sysFsRoot = getenv("I2C_SYSFS_ROOT") ? getenv("I2C_SYSFS_ROOT")
+				: "/sys";
+	}
+
+	void tearDown() {
+		setDeferred(std::to_string(eepromAddr) + " off");
+		bus.reset();
+	}
+
+	void testTransfer() {
+		setDeferred(std::to_string(eepromAddr));
+		uint8_t out[] = { 0x20, 0x11, 0x22, 0x33 };
+		bus->write(eepromAddr, out, sizeof(out));
+		uint8_t in[3] = { 0 };
+		bus->writeRead(eepromAddr, out, 1, in, sizeof(in));
+		CPPUNIT_ASSERT(in[0] == 0x11 && in[1] == 0x22 && in[2] == 0x33);
+	}
+
+	void testNotBlocking() {
+		setDeferred(std::to_string(eepromAddr) + " " + std::to_string(delay));
+
+		// Slow access in a child, with its own file descriptor
+		auto start = std::chrono::steady_clock::now();
+		pid_t child = fork();
+		CPPUNIT_ASSERT(child >= 0);
+		if (child == 0) {
+			i2c::I2cBus eepromBus(busNum);
+			uint8_t addr = 0x20;
+			uint8_t data[3];
+			eepromBus.writeRead(eepromAddr, &addr, 1, data, sizeof(data));
+			_exit(0);
+		}
+
+		// Give the child time to hand off its transfer
+		usleep(delay / 4);
+
+		// The hub isn't locked while the slave processes the transfer
+		auto hubStart = std::chrono::steady_clock::now();
+		std::ifstream deferred(sysFsRoot + "/bus/i2c/devices/i2c-"
+				+ std::to_string(busNum - 1) + "/deferred");
+		std::string setting;
+		std::getline(deferred, setting);
+		long hubTime = elapsedMs(hubStart);
+
+		// Nor is the master's bus, other slaves can be accessed
+		auto dsStart = std::chrono::steady_clock::now();
+		uint8_t command = 0xaa;
+		uint8_t temperature[2];
+		bus->writeRead(ds1621Addr, &command, 1, temperature,
+				sizeof(temperature));
+		long dsTime = elapsedMs(dsStart);
+		long dsDone = elapsedMs(start);
+
+		int status;
+		CPPUNIT_ASSERT(waitpid(child, &status, 0) == child);
+		CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		CPPUNIT_ASSERT(setting == "0x50 " + std::to_string(delay));
+		CPPUNIT_ASSERT(elapsedMs(start) >= delay / 1000);
+		CPPUNIT_ASSERT(hubTime < delay / 2000);
+		CPPUNIT_ASSERT(dsTime < delay / 2000);
+		CPPUNIT_ASSERT(dsDone < delay / 1000);
+	}
+};
+
+#endif /* DEFERREDTEST_H_ */
@@ -38,50 +38,27 @@ int Ds1621Test::showTout() {
 	return state;
 }
 
+/**
+ * Waits for a sysfs notification on the given file. Reads the
+ * file's content (again) afterwards to re-arm the notification.
+ */
+bool Ds1621Test::awaitChange(int fd, int timeout) {
+	struct pollfd pfd = { fd, POLLPRI, 0 };
+	int res = poll(&pfd, 1, timeout);
+	CPPUNIT_ASSERT_MESSAGE("Cannot poll sysfs file", res >= 0);
+	char buf[16];
+	lseek(fd, 0, SEEK_SET);
+	CPPUNIT_ASSERT_MESSAGE("Cannot read sysfs file",
+			read(fd, buf, sizeof(buf)) > 0);
+	return res > 0 && (pfd.revents & POLLPRI);
+}
+
 float Ds1621Test::readTemperatureLowPrecision() {
-	unsigned char out[] = { readTemperature };
-	int res = write(ds1621Dev, out, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
-	// read
-	unsigned char in[2];
-	res = read(ds1621Dev, in, 2);
-	CPPUNIT_ASSERT_MESSAGE("Failed to read data", res == 2);
-	int16_t val = in[0] << 8 | in[1];
-	val >>= 7;
-	if (val & 0x100) {
-		val |= 0xfe00;
-	}
-	return val / 2.0;
+	return ds1621->temperature();
 }
 
 float Ds1621Test::readTemperatureHighPrecision() {
-	unsigned char out[] = { readTemperature };
-	// Get temperature
-	int res = write(ds1621Dev, out, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
-	unsigned char temp[2];
-	res = read(ds1621Dev, temp, 2);
-	CPPUNIT_ASSERT_MESSAGE("Failed to read data", res == 2);
-
-	// Get counter
-	out[0] = readCounter;
-	res = write(ds1621Dev, out, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
-	unsigned char count_remain;
-	res = read(ds1621Dev, &count_remain, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to read data", res == 1);
-
-	// Get slope
-	out[0] = readSlope;
-	res = write(ds1621Dev, out, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
-	unsigned char count_per_c;
-	res = read(ds1621Dev, &count_per_c, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to read data", res == 1);
-
-	float temperature = (char)temp[0] - 0.25
-			+ (count_per_c - count_remain) / (float)count_per_c;
-	return temperature;
+	return ds1621->temperatureHighPrecision();
 }
 
 bool Ds1621Test::cmpCents(float a, float b) {
@@ -89,32 +66,32 @@ bool Ds1621Test::cmpCents(float a, float b) {
 }
 
 void Ds1621Test::writeAc(uint8_t value) {
-	unsigned char out[] = { accessAC, value };
-	int res = write(ds1621Dev, out, 2);
-	CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 2);
+	ds1621->setConfig(value);
 }
 
-uint8_t Ds1621Test::Ds1621Test::readAc() {
-	unsigned char out[] = { accessAC };
-	int res = write(ds1621Dev, out, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
-	// read
-	unsigned char ac;
-	res = read(ds1621Dev, &ac, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to read data", res == 1);
-	return ac;
+uint8_t Ds1621Test::readAc() {
+	return ds1621->config();
 }
 
 void Ds1621Test::startContinuousConversion() {
-	// Start continuous conversion
-	unsigned char out[] = { startConvertT };
-	int res = write(ds1621Dev, out, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
+	ds1621->startConversion();
 }
 
 void Ds1621Test::stopContinuousConversion() {
-	// Stop continuous conversion
-	unsigned char out[] = { stopConvertT };
-	int res = write(ds1621Dev, out, 1);
-	CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
+	ds1621->stopConversion();
+}
+
+int Ds1621Test::smbusAccess(char readWrite, uint8_t command, int size,
+		union i2c_smbus_data *data) {
+	struct i2c_smbus_ioctl_data args = { (__u8)readWrite, command,
+			(__u32)size, data };
+	return ioctl(ds1621Dev, I2C_SMBUS, &args);
+}
+
+void Ds1621Test::injectPecErrors(int count) {
+	std::ofstream inject(sysFsRoot + "/bus/i2c/devices/i2c-"
+			+ std::to_string(hubNum) + "/pec_inject");
+	inject << DS1621_ADDR << " " << count;
+	inject.close();
+	CPPUNIT_ASSERT_MESSAGE("Cannot inject PEC errors", !inject.fail());
 }
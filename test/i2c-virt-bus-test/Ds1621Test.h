@@ -8,17 +8,22 @@
 #ifndef DS1621TEST_H_
 #define DS1621TEST_H_
 
+#include <memory>
 #include <string>
 #include <cstdint>
 #include <fstream>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <cppunit/TestFixture.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include "client/Ds1621.h"
+
 #define STR_EXPAND(tok) #tok
 #define STR(tok) STR_EXPAND(tok)
 
@@ -32,23 +37,25 @@ class Ds1621Test : public CppUnit::TestFixture {
 	CPPUNIT_TEST(testLowFlag);
 	CPPUNIT_TEST(testHighFlag);
 	CPPUNIT_TEST(testTout);
+	CPPUNIT_TEST(testToutNotify);
+	CPPUNIT_TEST(testBulkStore);
+	CPPUNIT_TEST(testConfigCache);
+	CPPUNIT_TEST(testPec);
 	CPPUNIT_TEST_SUITE_END();
 
 private:
+	std::unique_ptr<i2c::I2cBus> bus;
+	std::unique_ptr<i2c::Ds1621> ds1621;
 	int ds1621Dev;
-	const unsigned char accessTh = 0xa1;
-	const unsigned char accessTl = 0xa2;
-	const unsigned char readTemperature = 0xaa;
-	const unsigned char readCounter = 0xa8;
-	const unsigned char readSlope = 0xa9;
-	const unsigned char accessAC = 0xac;
-	const unsigned char startConvertT = 0xee;
-	const unsigned char stopConvertT = 0x22;
+	int hubNum;
+	/** Where sysfs is mounted (see I2C_SYSFS_ROOT). */
+	std::string sysFsRoot;
 	std::string sysFsDir;
 
 	void testRw(unsigned char data[]);
 	void storeTemperature(float temperature);
 	int showTout();
+	bool awaitChange(int fd, int timeout);
 	float readTemperatureLowPrecision();
 	float readTemperatureHighPrecision();
 	bool cmpCents(float a, float b);
@@ -56,44 +63,48 @@ private:
 	uint8_t readAc();
 	void startContinuousConversion();
 	void stopContinuousConversion();
+	int smbusAccess(char readWrite, uint8_t command, int size,
+			union i2c_smbus_data *data);
+	void injectPecErrors(int count);
 
 public:
 	void setUp() {
 		CPPUNIT_ASSERT_MESSAGE("I2C_BUS_NUM not set in environment",
 				getenv("I2C_BUS_NUM") != nullptr);
 		int busNum = stoi(std::string(getenv("I2C_BUS_NUM")));
-		std::string i2cBus = "/dev/i2c-" + std::to_string(busNum);
-		ds1621Dev = open(i2cBus.c_str(), O_RDWR);
-		std::ostringstream msg;
-		msg << "Cannot open i2c bus " << i2cBus;
-		CPPUNIT_ASSERT_MESSAGE(msg.str(), ds1621Dev >= 0);
+		bus.reset(new i2c::I2cBus(busNum));
+		ds1621.reset(new i2c::Ds1621(*bus, DS1621_ADDR));
+		ds1621Dev = bus->fd();
 		int res = ioctl(ds1621Dev, I2C_SLAVE, DS1621_ADDR);
 		CPPUNIT_ASSERT_MESSAGE(
 				"Failed to acquire bus access and/or talk to slave", res >= 0);
-		sysFsDir = "/sys/devices/i2c-"
-				+ std::to_string(busNum - 1) + "/1-1048";
+		hubNum = busNum - 1;
+		// Allows running against the file system of i2c-cuse-sim
+		sysFsRoot = getenv("I2C_SYSFS_ROOT") ? getenv("I2C_SYSFS_ROOT")
+				: "/sys";
+		sysFsDir = sysFsRoot + "/devices/i2c-" + std::to_string(hubNum)
+				+ "/" + std::to_string(hubNum) + "-1048";
 	}
 
 	void tearDown() {
-		close(ds1621Dev);
+		ds1621.reset();
+		bus.reset();
 	}
 
 	void testRwTh() {
-		unsigned char out[] = { accessTh, 0x12, 0x34 };
+		unsigned char out[] = { i2c::Ds1621::accessTh, 0x12, 0x34 };
 		testRw(out);
 	}
 
 	void testRwTl() {
-		unsigned char out[] = { accessTl, 0x56, 0x78 };
+		unsigned char out[] = { i2c::Ds1621::accessTl, 0x56, 0x78 };
 		testRw(out);
 	}
 
 	void testSingle() {
 		storeTemperature(42.42);
 		CPPUNIT_ASSERT(readTemperatureLowPrecision() != 42);
-		unsigned char out[] = { startConvertT };
-		int res = write(ds1621Dev, out, 1);
-		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
+		ds1621->startConversion();
 		CPPUNIT_ASSERT(readTemperatureLowPrecision() == 42.5);
 	}
 
@@ -147,9 +158,7 @@ public:
 		writeAc(readAc() & ~0x60);
 		CPPUNIT_ASSERT((readAc() & 0x6c) == 0x8);
 
-		unsigned char out[] = { accessTl, -10 & 0xff, 0 };
-		int res = write(ds1621Dev, out, 3);
-		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 3);
+		ds1621->setTl((-10 & 0xff) << 8);
 
 		float temp = 0;
 		while (temp > -20) {
@@ -170,9 +179,7 @@ public:
 		storeTemperature(0);
 		writeAc(readAc() & ~0x60);
 
-		unsigned char out[] = { accessTh, 50, 0 };
-		int res = write(ds1621Dev, out, 3);
-		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 3);
+		ds1621->setTh(50 << 8);
 
 		float temp = 0;
 		while (temp < 100) {
@@ -194,17 +201,11 @@ public:
 		writeAc(readAc() & ~0x2);
 
 		// Threshold high 25
-		unsigned char out[] = { accessTh, 25, 0 };
-		int res = write(ds1621Dev, out, 3);
-		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 3);
+		ds1621->setTh(25 << 8);
 		// Threshold low 25
-		out[0] = accessTl;
-		res = write(ds1621Dev, out, 3);
-		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 3);
+		ds1621->setTl(25 << 8);
 		// Threshold low 18
-		out[1] = 18;
-		res = write(ds1621Dev, out, 3);
-		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 3);
+		ds1621->setTl(18 << 8);
 
 		CPPUNIT_ASSERT(showTout() == 1);
 		writeAc(readAc() | 0x2);
@@ -223,6 +224,106 @@ public:
 
 		stopContinuousConversion();
 	}
+
+	void testToutNotify() {
+		startContinuousConversion();
+
+		// Thresholds 25/18, active high, Tout inactive
+		ds1621->setTh(25 << 8);
+		ds1621->setTl(18 << 8);
+		writeAc(readAc() | 0x2);
+		storeTemperature(17);
+		CPPUNIT_ASSERT(showTout() == 0);
+
+		int tout = open((sysFsDir + "/tout").c_str(), O_RDONLY);
+		CPPUNIT_ASSERT_MESSAGE("Cannot open Tout", tout >= 0);
+		char buf[16];
+		CPPUNIT_ASSERT(read(tout, buf, sizeof(buf)) > 0);
+
+		// No edge, no notification
+		storeTemperature(22);
+		CPPUNIT_ASSERT(!awaitChange(tout, 0));
+
+		// Edges
+		storeTemperature(26);
+		CPPUNIT_ASSERT(awaitChange(tout, 1000));
+		CPPUNIT_ASSERT(showTout() == 1);
+		storeTemperature(17);
+		CPPUNIT_ASSERT(awaitChange(tout, 1000));
+		CPPUNIT_ASSERT(showTout() == 0);
+
+		close(tout);
+		stopContinuousConversion();
+	}
+
+	void testBulkStore() {
+		startContinuousConversion();
+
+		struct {
+			uint16_t adapter;
+			uint16_t addr;
+			int32_t temperature;
+		} records[] = {
+			{ (uint16_t)hubNum, 0x4f, 12000 },
+			{ (uint16_t)hubNum, DS1621_ADDR, 33000 },
+		};
+		std::ofstream temps(sysFsRoot
+				+ "/bus/i2c/drivers/i2c-slave-ds1621/temperatures",
+				std::ios::binary);
+		temps.write((const char*)records, sizeof(records));
+		temps.close();
+		CPPUNIT_ASSERT_MESSAGE("Cannot store temperatures", !temps.fail());
+		CPPUNIT_ASSERT(readTemperatureLowPrecision() == 33);
+
+		stopContinuousConversion();
+	}
+
+	void testConfigCache() {
+		stopContinuousConversion();
+		writeAc(readAc() & ~0x2);
+		uint8_t ac = readAc();
+
+		// Change POL without the client library noticing
+		unsigned char out[] = { i2c::Ds1621::accessConfig,
+				(unsigned char)(ac | 0x2) };
+		int res = write(ds1621Dev, out, 2);
+		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 2);
+		CPPUNIT_ASSERT(readAc() == ac);
+		ds1621->invalidate();
+		CPPUNIT_ASSERT(readAc() == (ac | 0x2));
+	}
+
+	void testPec() {
+		CPPUNIT_ASSERT(ioctl(ds1621Dev, I2C_PEC, 1) >= 0);
+
+		// SMBus words are sent LSB first, the DS1621 sends MSB first
+		union i2c_smbus_data data;
+		data.word = 0x8012;
+		CPPUNIT_ASSERT(smbusAccess(I2C_SMBUS_WRITE, i2c::Ds1621::accessTh,
+				I2C_SMBUS_WORD_DATA, &data) >= 0);
+		data.word = 0;
+		CPPUNIT_ASSERT(smbusAccess(I2C_SMBUS_READ, i2c::Ds1621::accessTh,
+				I2C_SMBUS_WORD_DATA, &data) >= 0);
+		CPPUNIT_ASSERT(data.word == 0x8012);
+
+		// Corrupted PEC from slave
+		injectPecErrors(1);
+		CPPUNIT_ASSERT(smbusAccess(I2C_SMBUS_READ, i2c::Ds1621::accessTh,
+				I2C_SMBUS_WORD_DATA, &data) < 0);
+		CPPUNIT_ASSERT(errno == EBADMSG);
+		CPPUNIT_ASSERT(smbusAccess(I2C_SMBUS_READ, i2c::Ds1621::accessTh,
+				I2C_SMBUS_WORD_DATA, &data) >= 0);
+
+		// Corrupted PEC from master, command is discarded
+		injectPecErrors(1);
+		data.word = 0x0034;
+		CPPUNIT_ASSERT(smbusAccess(I2C_SMBUS_WRITE, i2c::Ds1621::accessTh,
+				I2C_SMBUS_WORD_DATA, &data) < 0);
+		CPPUNIT_ASSERT(errno == EIO);
+		CPPUNIT_ASSERT(ds1621->th() == 0x1280);
+
+		CPPUNIT_ASSERT(ioctl(ds1621Dev, I2C_PEC, 0) >= 0);
+	}
 };
 
 
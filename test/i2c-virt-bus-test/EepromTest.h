@@ -12,10 +12,13 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <cppunit/TestFixture.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include "client/Eeprom24Cxx.h"
+
 #define STR_EXPAND(tok) #tok
 #define STR(tok) STR_EXPAND(tok)
 
@@ -23,6 +26,9 @@ class EepromTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST_SUITE(EepromTest);
 	CPPUNIT_TEST(testSimpleRW);
 	CPPUNIT_TEST(testMultipleRW);
+	CPPUNIT_TEST(testBlockRead);
+	CPPUNIT_TEST(testBadBlockLength);
+	CPPUNIT_TEST(testPagedWrite);
 	CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -65,6 +71,70 @@ public:
 	void testMultipleRW() {
 	}
 
+	void testBlockRead() {
+		// Length prefixed data at 0x0100
+		char out[] = { 1, 0, 5, 1, 2, 3, 4, 5 };
+		int res = write(eepromDev, out, 8);
+		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 8);
+
+		// Read back in a single transfer
+		unsigned char in[1 + I2C_SMBUS_BLOCK_MAX] = { 1 };
+		CPPUNIT_ASSERT(readBlock(0x100, in, sizeof(in)) == 6);
+		for (int i = 0; i < 6; i++) {
+			CPPUNIT_ASSERT(in[i] == out[2 + i]);
+		}
+	}
+
+	void testBadBlockLength() {
+		char out[] = { 1, 0x10, 0 };
+		int res = write(eepromDev, out, 3);
+		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 3);
+
+		unsigned char in[1 + I2C_SMBUS_BLOCK_MAX] = { 1 };
+		CPPUNIT_ASSERT(readBlock(0x110, in, sizeof(in)) < 0);
+	}
+
+	void testPagedWrite() {
+		i2c::I2cBus bus(stoi(std::string(getenv("I2C_BUS_NUM"))));
+		i2c::Eeprom24Cxx eeprom = i2c::Eeprom24Cxx::at24c32(bus, EEPROM_ADDR);
+
+		// Starts in the middle of a page and spans several pages
+		uint8_t out[100];
+		for (unsigned int i = 0; i < sizeof(out); i++) {
+			out[i] = i * 7;
+		}
+		eeprom.write(0x210, out, sizeof(out));
+		uint8_t in[sizeof(out)];
+		eeprom.read(0x210, in, sizeof(in));
+		for (unsigned int i = 0; i < sizeof(out); i++) {
+			CPPUNIT_ASSERT(in[i] == out[i]);
+		}
+	}
+
+private:
+	/**
+	 * Reads a block with the length given by its first byte.
+	 * Returns the number of bytes read (including the length byte)
+	 * or -1.
+	 */
+	int readBlock(int offset, unsigned char *in, int size) {
+		unsigned char addr[] = { (unsigned char)(offset >> 8),
+				(unsigned char)offset };
+		struct i2c_msg msgs[] = {
+			{ EEPROM_ADDR, 0, 2, addr },
+			{ EEPROM_ADDR, I2C_M_RD | I2C_M_RECV_LEN,
+					(__u16)size, in },
+		};
+		// i2c-dev expects the initial length in the first byte
+		in[0] = 1;
+		struct i2c_rdwr_ioctl_data xfer = { msgs, 2 };
+		if (ioctl(eepromDev, I2C_RDWR, &xfer) < 0) {
+			return -1;
+		}
+		// i2c-dev doesn't copy the updated length back
+		return in[0] + 1;
+	}
+
 };
 
 #endif /* EEPROMTEST_H_ */
@@ -0,0 +1,197 @@
+/*
+ * ImuTest.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef IMUTEST_H_
+#define IMUTEST_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "client/I2cBus.h"
+
+class ImuTest : public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE(ImuTest);
+	CPPUNIT_TEST(testWhoAmI);
+	CPPUNIT_TEST(testBurstRead);
+	CPPUNIT_TEST(testWatermark);
+	CPPUNIT_TEST(testFifoMode);
+	CPPUNIT_TEST(testContinuousMode);
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	std::unique_ptr<i2c::I2cBus> bus;
+	/** The IMU (see setup-test). */
+	const uint16_t imuAddr = 0x6a;
+	const uint8_t regFifoCtrl1 = 0x07;
+	const uint8_t regFifoCtrl4 = 0x0a;
+	const uint8_t regWhoAmI = 0x0f;
+	const uint8_t regCtrl1 = 0x10;
+	const uint8_t regFifoStatus1 = 0x3a;
+	const uint8_t regFifoData = 0x3e;
+	const uint8_t statusWtm = 0x80;
+	const uint8_t statusOvr = 0x40;
+	const uint8_t statusFull = 0x20;
+	const uint8_t statusEmpty = 0x10;
+	const int fifoSize = 512;
+	const int sampleSize = 12;
+
+	void writeRegister(uint8_t reg, uint8_t value) {
+		uint8_t out[] = { reg, value };
+		bus->write(imuAddr, out, sizeof(out));
+	}
+
+	/**
+	 * Starts sampling with the given data rate code into an empty
+	 * FIFO with the given mode.
+	 */
+	void start(uint8_t mode, uint8_t odr) {
+		writeRegister(regFifoCtrl4, mode);
+		writeRegister(regCtrl1, odr << 4);
+	}
+
+	/**
+	 * Reads the FIFO status registers, returns the number of samples
+	 * and sets the flags.
+	 */
+	int fifoStatus(uint8_t& flags) {
+		uint8_t status[2];
+		bus->writeRead(imuAddr, &regFifoStatus1, 1, status, sizeof(status));
+		flags = status[1] & 0xf0;
+		return status[0] | ((status[1] & 0x03) << 8);
+	}
+
+	/**
+	 * Reads the given number of samples with a single burst read
+	 * and returns the sequence number of the first sample. Fails
+	 * if the samples aren't consecutive.
+	 */
+	uint16_t readSamples(int count) {
+		std::vector<uint8_t> data(count * sampleSize);
+		bus->writeRead(imuAddr, &regFifoData, 1, data.data(), data.size());
+		uint16_t first = data[0] | (data[1] << 8);
+		for (int i = 0; i < count; i++) {
+			uint8_t *sample = &data[i * sampleSize];
+			uint16_t seq = sample[0] | (sample[1] << 8);
+			uint16_t inv = sample[2] | (sample[3] << 8);
+			CPPUNIT_ASSERT(seq == (uint16_t)(first + i));
+			CPPUNIT_ASSERT(inv == (uint16_t)~seq);
+			// 1 g on z
+			CPPUNIT_ASSERT(sample[10] == 0 && sample[11] == 0x40);
+		}
+		return first;
+	}
+
+public:
+	void setUp() {
+		CPPUNIT_ASSERT_MESSAGE("I2C_BUS_NUM not set in environment",
+				getenv("I2C_BUS_NUM") != nullptr);
+		bus.reset(new i2c::I2cBus(stoi(std::string(getenv("I2C_BUS_NUM")))));
+	}
+
+	void tearDown() {
+		writeRegister(regCtrl1, 0);
+		writeRegister(regFifoCtrl4, 0);
+		bus.reset();
+	}
+
+	void testWhoAmI() {
+		uint8_t id;
+		bus->writeRead(imuAddr, &regWhoAmI, 1, &id, 1);
+		CPPUNIT_ASSERT(id == 0x6c);
+	}
+
+	void testBurstRead() {
+		// 6664 Hz for 20 ms, i.e. about 130 samples
+		start(6, 10);
+		usleep(20000);
+		uint8_t flags;
+		int count = fifoStatus(flags);
+		CPPUNIT_ASSERT(count > 50 && count < fifoSize);
+		CPPUNIT_ASSERT(!(flags & (statusOvr | statusEmpty)));
+
+		// Drain with two burst reads, splitting a sample
+		std::vector<uint8_t> data(count * sampleSize);
+		bus->writeRead(imuAddr, &regFifoData, 1, data.data(), 5);
+		bus->writeRead(imuAddr, &regFifoData, 1, data.data() + 5,
+				data.size() - 5);
+		uint16_t first = data[0] | (data[1] << 8);
+		for (int i = 0; i < count; i++) {
+			uint16_t seq = data[i * sampleSize]
+					| (data[i * sampleSize + 1] << 8);
+			CPPUNIT_ASSERT(seq == (uint16_t)(first + i));
+		}
+
+		// Later samples follow
+		writeRegister(regCtrl1, 0);
+		int next = fifoStatus(flags);
+		if (next > 0) {
+			CPPUNIT_ASSERT(readSamples(next) == (uint16_t)(first + count));
+		}
+		fifoStatus(flags);
+		CPPUNIT_ASSERT(flags & statusEmpty);
+	}
+
+	void testWatermark() {
+		writeRegister(regFifoCtrl1, 20);
+		// 416 Hz
+		start(6, 6);
+		uint8_t flags;
+		int count = fifoStatus(flags);
+		CPPUNIT_ASSERT(count < 20 && !(flags & statusWtm));
+		usleep(100000);
+		count = fifoStatus(flags);
+		CPPUNIT_ASSERT(count >= 20 && (flags & statusWtm));
+		readSamples(count);
+		writeRegister(regFifoCtrl1, 0);
+	}
+
+	void testFifoMode() {
+		// 6664 Hz for 100 ms fills the FIFO and stops sampling
+		start(1, 10);
+		usleep(100000);
+		uint8_t flags;
+		CPPUNIT_ASSERT(fifoStatus(flags) == fifoSize);
+		CPPUNIT_ASSERT((flags & (statusFull | statusOvr))
+				== (statusFull | statusOvr));
+		// Overrun is cleared by reading the status
+		fifoStatus(flags);
+		CPPUNIT_ASSERT(!(flags & statusOvr));
+
+		// Stopped, the first sample is the first one generated
+		uint16_t first = readSamples(fifoSize);
+		usleep(10000);
+		CPPUNIT_ASSERT(fifoStatus(flags) == 0);
+		CPPUNIT_ASSERT(flags & statusEmpty);
+
+		// Writing the mode restarts the FIFO
+		writeRegister(regFifoCtrl4, 1);
+		usleep(10000);
+		CPPUNIT_ASSERT(fifoStatus(flags) > 0);
+		CPPUNIT_ASSERT(readSamples(1) == (uint16_t)(first + fifoSize));
+	}
+
+	void testContinuousMode() {
+		start(6, 10);
+		usleep(2000);
+		uint16_t early = readSamples(1);
+		usleep(100000);
+		uint8_t flags;
+		CPPUNIT_ASSERT(fifoStatus(flags) == fifoSize);
+		CPPUNIT_ASSERT(flags & statusOvr);
+		// The samples following the early one have been overwritten
+		uint16_t first = readSamples(fifoSize);
+		CPPUNIT_ASSERT((uint16_t)(first - early) > 1);
+	}
+
+};
+
+#endif /* IMUTEST_H_ */
@@ -0,0 +1,143 @@
+/*
+ * MuxTest.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef MUXTEST_H_
+#define MUXTEST_H_
+
+#include <climits>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class MuxTest : public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE(MuxTest);
+	CPPUNIT_TEST(testControl);
+	CPPUNIT_TEST(testChannel);
+	CPPUNIT_TEST(testKernelMux);
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	int busDev;
+	const int muxAddr = 0x70;
+	/** A DS1621 attached to channel 3 (see setup-test). */
+	const int chanDevAddr = 0x4a;
+	const int chanDevChannel = 3;
+	const unsigned char accessAC = 0xac;
+	/**
+	 * A PCA9546 driven by the kernel's pca954x driver, with a
+	 * DS1621 attached to channel 1 (see setup-test).
+	 */
+	const int kernelMuxAddr = 0x71;
+	const int kernelChanDevAddr = 0x4b;
+	const int kernelChanDevChannel = 1;
+
+	void selectChannels(unsigned char channels) {
+		int res = ioctl(busDev, I2C_SLAVE, muxAddr);
+		CPPUNIT_ASSERT_MESSAGE("Failed to talk to mux", res >= 0);
+		res = write(busDev, &channels, 1);
+		CPPUNIT_ASSERT_MESSAGE("Failed to write control", res == 1);
+	}
+
+public:
+	/**
+	 * Returns the device of the adapter that the kernel's i2c-mux
+	 * framework has created for the channel.
+	 */
+	std::string channelDevice(int channel) {
+		std::ostringstream link;
+		link << "/sys/bus/i2c/devices/" << getenv("I2C_BUS_NUM") << "-"
+				<< std::hex << std::setw(4) << std::setfill('0')
+				<< kernelMuxAddr << "/channel-" << std::dec << channel;
+		char target[PATH_MAX];
+		ssize_t len = readlink(link.str().c_str(), target,
+				sizeof(target) - 1);
+		CPPUNIT_ASSERT_MESSAGE("No channel adapter " + link.str(), len > 0);
+		target[len] = 0;
+		return "/dev/" + std::string(basename(target));
+	}
+
+	void setUp() {
+		CPPUNIT_ASSERT_MESSAGE("I2C_BUS_NUM not set in environment",
+				getenv("I2C_BUS_NUM") != nullptr);
+		std::string i2cBus = "/dev/i2c-" + std::string(getenv("I2C_BUS_NUM"));
+		busDev = open(i2cBus.c_str(), O_RDWR);
+		std::ostringstream msg;
+		msg << "Cannot open i2c bus " << i2cBus;
+		CPPUNIT_ASSERT_MESSAGE(msg.str(), busDev >= 0);
+	}
+
+	void tearDown() {
+		selectChannels(0);
+		close(busDev);
+	}
+
+	void testControl() {
+		selectChannels(0x81);
+		unsigned char control;
+		int res = read(busDev, &control, 1);
+		CPPUNIT_ASSERT_MESSAGE("Failed to read control", res == 1);
+		CPPUNIT_ASSERT(control == 0x81);
+	}
+
+	void testChannel() {
+		unsigned char out[] = { accessAC };
+
+		// Not reachable with channel disabled
+		selectChannels(0);
+		int res = ioctl(busDev, I2C_SLAVE, chanDevAddr);
+		CPPUNIT_ASSERT_MESSAGE("Failed to talk to slave", res >= 0);
+		res = write(busDev, out, 1);
+		CPPUNIT_ASSERT(res < 0);
+
+		// Reachable with channel enabled
+		selectChannels(1 << chanDevChannel);
+		res = ioctl(busDev, I2C_SLAVE, chanDevAddr);
+		CPPUNIT_ASSERT_MESSAGE("Failed to talk to slave", res >= 0);
+		res = write(busDev, out, 1);
+		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
+		unsigned char ac;
+		res = read(busDev, &ac, 1);
+		CPPUNIT_ASSERT_MESSAGE("Failed to read data", res == 1);
+		CPPUNIT_ASSERT((ac & 0x8) == 0x8);
+	}
+
+	void testKernelMux() {
+		// Access through the channel's adapter selects the channel
+		std::string chanBus = channelDevice(kernelChanDevChannel);
+		int chanDev = open(chanBus.c_str(), O_RDWR);
+		CPPUNIT_ASSERT_MESSAGE("Cannot open " + chanBus, chanDev >= 0);
+		int res = ioctl(chanDev, I2C_SLAVE, kernelChanDevAddr);
+		CPPUNIT_ASSERT_MESSAGE("Failed to talk to slave", res >= 0);
+		unsigned char out[] = { accessAC };
+		res = write(chanDev, out, 1);
+		CPPUNIT_ASSERT_MESSAGE("Failed to write data", res == 1);
+		unsigned char ac;
+		res = read(chanDev, &ac, 1);
+		close(chanDev);
+		CPPUNIT_ASSERT_MESSAGE("Failed to read data", res == 1);
+		CPPUNIT_ASSERT((ac & 0x8) == 0x8);
+
+		// The driver has set the simulated multiplexer's control
+		// register (the address is in use by the driver)
+		res = ioctl(busDev, I2C_SLAVE_FORCE, kernelMuxAddr);
+		CPPUNIT_ASSERT_MESSAGE("Failed to talk to mux", res >= 0);
+		unsigned char control;
+		res = read(busDev, &control, 1);
+		CPPUNIT_ASSERT_MESSAGE("Failed to read control", res == 1);
+		CPPUNIT_ASSERT(control == 1 << kernelChanDevChannel);
+	}
+};
+
+#endif /* MUXTEST_H_ */
@@ -0,0 +1,94 @@
+/*
+ * Ds1621.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Ds1621.h"
+
+namespace i2c {
+
+uint16_t Ds1621::readWord(uint8_t cmd) {
+	uint8_t in[2];
+	bus.writeRead(addr, &cmd, 1, in, 2);
+	return in[0] << 8 | in[1];
+}
+
+void Ds1621::writeWord(uint8_t cmd, uint16_t value) {
+	uint8_t out[] = { cmd, (uint8_t)(value >> 8), (uint8_t)value };
+	bus.write(addr, out, 3);
+	// Thresholds affect the flags
+	configValid = false;
+}
+
+void Ds1621::command(uint8_t cmd) {
+	bus.write(addr, &cmd, 1);
+}
+
+uint8_t Ds1621::config() {
+	if (configValid) {
+		return configCache;
+	}
+	uint8_t value;
+	bus.writeRead(addr, &accessConfig, 1, &value, 1);
+	configCache = value;
+	configValid = !converting;
+	return value;
+}
+
+void Ds1621::setConfig(uint8_t value) {
+	uint8_t out[] = { accessConfig, value };
+	bus.write(addr, out, 2);
+	configValid = false;
+}
+
+void Ds1621::startConversion() {
+	command(startConvertT);
+	// Not converting any longer after a one shot conversion
+	// (if we know that 1SHOT is set).
+	converting = !(configValid && (configCache & config1Shot));
+	configValid = false;
+}
+
+void Ds1621::stopConversion() {
+	command(stopConvertT);
+	converting = false;
+	configValid = false;
+}
+
+float Ds1621::temperature() {
+	return toCelsius(readWord(readTemperature) & 0xff80);
+}
+
+float Ds1621::temperatureHighPrecision() {
+	uint8_t temp[2];
+	uint8_t countRemain;
+	uint8_t countPerC = slopeCache;
+	struct i2c_msg msgs[] = {
+		{ addr, 0, 1, (__u8*)&readTemperature },
+		{ addr, I2C_M_RD, 2, temp },
+		{ addr, 0, 1, (__u8*)&readCounter },
+		{ addr, I2C_M_RD, 1, &countRemain },
+		{ addr, 0, 1, (__u8*)&readSlope },
+		{ addr, I2C_M_RD, 1, &countPerC },
+	};
+	bus.transfer(msgs, slopeValid ? 4 : 6);
+	slopeCache = countPerC;
+	slopeValid = true;
+
+	return (int8_t)temp[0] - 0.25
+			+ (countPerC - countRemain) / (float)countPerC;
+}
+
+void Ds1621::invalidate() {
+	converting = true;
+	configValid = false;
+	slopeValid = false;
+}
+
+float Ds1621::toCelsius(uint16_t value) {
+	return (int16_t)value / 256.0;
+}
+
+}
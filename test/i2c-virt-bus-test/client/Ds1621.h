@@ -0,0 +1,89 @@
+/*
+ * Ds1621.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef CLIENT_DS1621_H_
+#define CLIENT_DS1621_H_
+
+#include <cstdint>
+
+#include "I2cBus.h"
+
+namespace i2c {
+
+/**
+ * A DS1621 on an I2C bus.
+ *
+ * The slope is cached after it has been read once. The configuration
+ * register is cached as long as the device is known not to be
+ * converting (its flags may change during conversion). If the
+ * device is accessed by other means (other clients, sysfs),
+ * invalidate() must be called.
+ */
+class Ds1621 {
+public:
+	static constexpr uint8_t accessTh = 0xa1;
+	static constexpr uint8_t accessTl = 0xa2;
+	static constexpr uint8_t readTemperature = 0xaa;
+	static constexpr uint8_t readCounter = 0xa8;
+	static constexpr uint8_t readSlope = 0xa9;
+	static constexpr uint8_t accessConfig = 0xac;
+	static constexpr uint8_t startConvertT = 0xee;
+	static constexpr uint8_t stopConvertT = 0x22;
+
+	static constexpr uint8_t configDone = 0x80;
+	static constexpr uint8_t configThf = 0x40;
+	static constexpr uint8_t configTlf = 0x20;
+	static constexpr uint8_t configPol = 0x02;
+	static constexpr uint8_t config1Shot = 0x01;
+
+	Ds1621(I2cBus& bus, uint16_t addr) : bus(bus), addr(addr) {}
+
+	/** Returns TH (as raw, left aligned register value). */
+	uint16_t th() { return readWord(accessTh); }
+	void setTh(uint16_t value) { writeWord(accessTh, value); }
+	/** Returns TL (as raw, left aligned register value). */
+	uint16_t tl() { return readWord(accessTl); }
+	void setTl(uint16_t value) { writeWord(accessTl, value); }
+
+	uint8_t config();
+	void setConfig(uint8_t value);
+
+	void startConversion();
+	void stopConversion();
+
+	/** Returns the temperature with a resolution of 0.5°C. */
+	float temperature();
+
+	/**
+	 * Returns the temperature calculated from the temperature,
+	 * the counter and the slope, read with a single transfer.
+	 */
+	float temperatureHighPrecision();
+
+	/** Invalidates all cached values. */
+	void invalidate();
+
+	/** Converts a raw temperature register value. */
+	static float toCelsius(uint16_t value);
+
+private:
+	I2cBus& bus;
+	uint16_t addr;
+	bool converting = true;
+	bool configValid = false;
+	uint8_t configCache = 0;
+	bool slopeValid = false;
+	uint8_t slopeCache = 0;
+
+	uint16_t readWord(uint8_t cmd);
+	void writeWord(uint8_t cmd, uint16_t value);
+	void command(uint8_t cmd);
+};
+
+}
+
+#endif /* CLIENT_DS1621_H_ */
@@ -0,0 +1,99 @@
+/*
+ * Eeprom24Cxx.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "Eeprom24Cxx.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace i2c {
+
+Eeprom24Cxx::Eeprom24Cxx(I2cBus& bus, uint16_t addr, std::size_t size,
+		std::size_t pageSize) : bus(bus), addr(addr), bytes(size),
+		pageSize(pageSize), addrLen(size > 2048 ? 2 : 1),
+		blockMask(addrLen == 1 && size > 256 ? size / 256 - 1 : 0) {
+}
+
+void Eeprom24Cxx::checkRange(std::size_t offset, std::size_t len) const {
+	if (offset > bytes || len > bytes - offset) {
+		throw std::out_of_range("Range exceeds size of EEPROM");
+	}
+}
+
+/**
+ * Returns the device address for accessing the offset.
+ */
+uint16_t Eeprom24Cxx::deviceAddress(std::size_t offset) const {
+	return addr | ((offset >> 8) & blockMask);
+}
+
+/**
+ * Puts the address bytes for the offset in the buffer and returns
+ * their number.
+ */
+std::size_t Eeprom24Cxx::setAddress(uint8_t *buf, std::size_t offset) const {
+	if (addrLen == 2) {
+		buf[0] = offset >> 8;
+		buf[1] = offset;
+	} else {
+		buf[0] = offset;
+	}
+	return addrLen;
+}
+
+void Eeprom24Cxx::read(std::size_t offset, uint8_t *data, std::size_t len) {
+	checkRange(offset, len);
+	if (len == 0) {
+		return;
+	}
+	uint8_t out[2];
+	bus.writeRead(deviceAddress(offset), out, setAddress(out, offset),
+			data, len);
+}
+
+/**
+ * Writes a page, repeating the write while the device doesn't
+ * acknowledge its address (ENXIO or EREMOTEIO, depending on the
+ * adapter) because it is still busy.
+ */
+void Eeprom24Cxx::writePage(uint16_t devAddr, const uint8_t *buf,
+		std::size_t len) {
+	auto deadline = std::chrono::steady_clock::now() + writeCycle;
+	while (true) {
+		try {
+			bus.write(devAddr, buf, len);
+			return;
+		} catch (const std::system_error& e) {
+			if ((e.code().value() != ENXIO && e.code().value() != EREMOTEIO)
+					|| std::chrono::steady_clock::now() > deadline) {
+				throw;
+			}
+		}
+	}
+}
+
+void Eeprom24Cxx::write(std::size_t offset, const uint8_t *data,
+		std::size_t len) {
+	checkRange(offset, len);
+	std::vector<uint8_t> buf(addrLen + std::min(len, pageSize));
+	while (len > 0) {
+		// Up to the end of the page
+		std::size_t chunk = std::min(len, pageSize - offset % pageSize);
+		std::size_t hdr = setAddress(buf.data(), offset);
+		std::memcpy(buf.data() + hdr, data, chunk);
+		writePage(deviceAddress(offset), buf.data(), hdr + chunk);
+		offset += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+}
@@ -0,0 +1,77 @@
+/*
+ * Eeprom24Cxx.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef CLIENT_EEPROM24CXX_H_
+#define CLIENT_EEPROM24CXX_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "I2cBus.h"
+
+namespace i2c {
+
+/**
+ * A 24Cxx EEPROM on an I2C bus. Devices up to 24C16 use one
+ * address byte, larger devices two. The 24C04, 24C08 and 24C16
+ * select the 256 byte block with the low bits of the device address.
+ */
+class Eeprom24Cxx {
+public:
+	/**
+	 * Creates a 24Cxx with the given size (in bytes) and page size.
+	 */
+	Eeprom24Cxx(I2cBus& bus, uint16_t addr, std::size_t size,
+			std::size_t pageSize);
+
+	static Eeprom24Cxx at24c02(I2cBus& bus, uint16_t addr) {
+		return Eeprom24Cxx(bus, addr, 256, 8);
+	}
+
+	static Eeprom24Cxx at24c32(I2cBus& bus, uint16_t addr) {
+		return Eeprom24Cxx(bus, addr, 4096, 32);
+	}
+
+	std::size_t size() const { return bytes; }
+
+	/**
+	 * Reads the given range with a single transfer.
+	 */
+	void read(std::size_t offset, uint8_t *data, std::size_t len);
+
+	/**
+	 * Writes the given range. The data is split in page writes,
+	 * each sent as a transfer of its own, as the device starts
+	 * writing a page only after the stop condition. While the device
+	 * is busy with writing the previous page, it doesn't acknowledge
+	 * its address, so the page write is repeated until it does
+	 * (acknowledge polling).
+	 */
+	void write(std::size_t offset, const uint8_t *data, std::size_t len);
+
+private:
+	/** The maximum time that the device is busy after a page write. */
+	static constexpr std::chrono::milliseconds writeCycle { 10 };
+
+	I2cBus& bus;
+	uint16_t addr;
+	std::size_t bytes;
+	std::size_t pageSize;
+	std::size_t addrLen;
+	/** The bits of the device address that select the block. */
+	uint16_t blockMask;
+
+	void checkRange(std::size_t offset, std::size_t len) const;
+	uint16_t deviceAddress(std::size_t offset) const;
+	std::size_t setAddress(uint8_t *buf, std::size_t offset) const;
+	void writePage(uint16_t devAddr, const uint8_t *buf, std::size_t len);
+};
+
+}
+
+#endif /* CLIENT_EEPROM24CXX_H_ */
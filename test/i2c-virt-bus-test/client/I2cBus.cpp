@@ -0,0 +1,72 @@
+/*
+ * I2cBus.cpp
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#include "I2cBus.h"
+
+#include <cerrno>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+namespace i2c {
+
+I2cBus::I2cBus(int busNum) : I2cBus("/dev/i2c-" + std::to_string(busNum)) {
+}
+
+I2cBus::I2cBus(const std::string& path) {
+	dev = open(path.c_str(), O_RDWR | O_CLOEXEC);
+	if (dev < 0) {
+		throw std::system_error(errno, std::generic_category(),
+				"Cannot open " + path);
+	}
+}
+
+I2cBus::I2cBus(I2cBus&& other) noexcept : dev(other.dev) {
+	other.dev = -1;
+}
+
+I2cBus& I2cBus::operator=(I2cBus&& other) noexcept {
+	if (this != &other) {
+		if (dev >= 0) {
+			close(dev);
+		}
+		dev = other.dev;
+		other.dev = -1;
+	}
+	return *this;
+}
+
+I2cBus::~I2cBus() {
+	if (dev >= 0) {
+		close(dev);
+	}
+}
+
+void I2cBus::transfer(struct i2c_msg *msgs, std::size_t count) {
+	struct i2c_rdwr_ioctl_data xfer = { msgs, (__u32)count };
+	if (ioctl(dev, I2C_RDWR, &xfer) < 0) {
+		throw std::system_error(errno, std::generic_category(), "I2C_RDWR");
+	}
+}
+
+void I2cBus::write(uint16_t addr, const uint8_t *data, std::size_t len) {
+	struct i2c_msg msg = { addr, 0, (__u16)len, (__u8*)data };
+	transfer(&msg, 1);
+}
+
+void I2cBus::writeRead(uint16_t addr, const uint8_t *out, std::size_t outLen,
+		uint8_t *in, std::size_t inLen) {
+	struct i2c_msg msgs[] = {
+		{ addr, 0, (__u16)outLen, (__u8*)out },
+		{ addr, I2C_M_RD, (__u16)inLen, in },
+	};
+	transfer(msgs, 2);
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+ * I2cBus.h
+ *
+ *  Created on: 19.10.2026
+ *      Author: mnl
+ */
+
+#ifndef CLIENT_I2CBUS_H_
+#define CLIENT_I2CBUS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <linux/i2c.h>
+
+namespace i2c {
+
+/**
+ * An open I2C bus (/dev/i2c-N). The file descriptor is closed
+ * when the object is destroyed. All accesses are done with
+ * I2C_RDWR, i.e. several messages can be combined in a single
+ * system call. Errors are reported by throwing std::system_error.
+ */
+class I2cBus {
+public:
+	explicit I2cBus(int busNum);
+	explicit I2cBus(const std::string& path);
+	I2cBus(const I2cBus&) = delete;
+	I2cBus& operator=(const I2cBus&) = delete;
+	I2cBus(I2cBus&& other) noexcept;
+	I2cBus& operator=(I2cBus&& other) noexcept;
+	~I2cBus();
+
+	int fd() const { return dev; }
+
+	/**
+	 * Executes the messages as a single (combined) transfer.
+	 */
+	void transfer(struct i2c_msg *msgs, std::size_t count);
+
+	/**
+	 * Writes the data to the device with the given address.
+	 */
+	void write(uint16_t addr, const uint8_t *data, std::size_t len);
+
+	/**
+	 * Writes the data (usually a register address or command)
+	 * and reads the response in a single transfer.
+	 */
+	void writeRead(uint16_t addr, const uint8_t *out, std::size_t outLen,
+			uint8_t *in, std::size_t inLen);
+
+private:
+	int dev;
+};
+
+}
+
+#endif /* CLIENT_I2CBUS_H_ */
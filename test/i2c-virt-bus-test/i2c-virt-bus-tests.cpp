@@ -3,11 +3,19 @@
 
 #include "EepromTest.h"
 #include "Ds1621Test.h"
+#include "MuxTest.h"
+#include "ImuTest.h"
+#include "DeferredTest.h"
+#include "BpfTest.h"
 
 int main(int argc, char **argv) {
 	CppUnit::TextUi::TestRunner runner;
 	runner.addTest(EepromTest::suite());
 	runner.addTest(Ds1621Test::suite());
+	runner.addTest(MuxTest::suite());
+	runner.addTest(ImuTest::suite());
+	runner.addTest(DeferredTest::suite());
+	runner.addTest(BpfTest::suite());
 	runner.run();
 	return 0;
 }